@@ -28,7 +28,16 @@ static const a9l_option accepted_options[] =
 	{"name", true },
 	{"location", true },
 	{"offset", false },
-	{"buttons", true }
+	{"buttons", true },
+	{"loads", false },
+	{"patch", false }
+};
+
+static const a9l_option accepted_load_options[] =
+{
+	{"location", true },
+	{"offset", false },
+	{"address", true }
 };
 
 static const char *button_strings[] = {
@@ -49,11 +58,17 @@ static const char *button_strings[] = {
 
 static bool check_match(const a9l_option list[], bool found_list[], size_t list_size, const char* string);
 static bool check_all_mandatory_found(const a9l_option list[], bool found_list[], size_t list_size);
+static bool check_string_token(const jsmntok_t *token);
+static bool validate_json_load_token(const char* json, const jsmntok_t *tokens, size_t amount, size_t *current_element);
 static bool validate_json_entry_token(const char* json, const jsmntok_t *tokens, size_t amount, size_t *current_element);
 static bool validate_json_tokens(const char* json, const jsmntok_t *tokens, size_t amount);
 static char *token_extract_string(const char *json, const jsmntok_t *token);
 static long token_extract_long(const char *json, const jsmntok_t *token, char** end);
+static unsigned long token_extract_unsigned_long(const char *json, const jsmntok_t *token, char** end);
 static bool token_extract_button(const char *json, const jsmntok_t *token, ctr_hid_button_type *button);
+static void free_locations(char *locations[], size_t num_locations);
+static void free_loads(a9l_config_load *loads, size_t num_loads);
+static bool parse_json_load_token(const char* json, const jsmntok_t *tokens, size_t *current_element, a9l_config_load *config_load);
 static bool parse_json_entry_token(const char* json, const jsmntok_t *tokens, size_t *current_element, a9l_config_entry *config_entry);
 static bool parse_json_tokens(const char* json, const jsmntok_t *tokens, a9l_config *config);
 
@@ -65,9 +80,13 @@ void a9l_config_initialize(a9l_config *config, size_t entries)
 		config->num_entries = entries;
 		for (size_t i = 0; i < entries; ++i)
 		{
-			config->entries[i].payload = NULL;
+			config->entries[i].payloads = NULL;
+			config->entries[i].num_payloads = 0;
 			config->entries[i].offset = 0;
 			config->entries[i].buttons = 0;
+			config->entries[i].loads = NULL;
+			config->entries[i].num_loads = 0;
+			config->entries[i].patch = NULL;
 		}
 	}
 }
@@ -94,19 +113,86 @@ size_t a9l_config_get_number_of_entries(const a9l_config *config)
 	return config->num_entries;
 }
 
-void a9l_config_entry_initialize(a9l_config_entry *entry, const char *payload, size_t offset, ctr_hid_button_type buttons)
+a9l_config_entry* a9l_config_find_entry(const a9l_config *config, ctr_hid_button_type buttons)
+{
+	size_t num_of_entries = a9l_config_get_number_of_entries(config);
+	for (size_t i = 0; i < num_of_entries; ++i)
+	{
+		a9l_config_entry *entry = a9l_config_get_entry(config, i);
+		if (entry->buttons == buttons)
+		{
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+bool a9l_config_entry_initialize(a9l_config_entry *entry, char * const payloads[], size_t num_payloads, size_t offset, ctr_hid_button_type buttons)
 {
-	entry->payload = malloc(strlen(payload) + 1);
-	strcpy(entry->payload, payload);
+	entry->payloads = malloc(sizeof(char*) * num_payloads);
+	entry->num_payloads = 0;
 	entry->offset = offset;
 	entry->buttons = buttons;
+	entry->loads = NULL;
+	entry->num_loads = 0;
+	entry->patch = NULL;
+	if (num_payloads && !entry->payloads)
+		return false;
+
+	for (size_t i = 0; i < num_payloads; ++i)
+	{
+		char *payload = malloc(strlen(payloads[i]) + 1);
+		if (!payload)
+		{
+			a9l_config_entry_destroy(entry);
+			return false;
+		}
+		strcpy(payload, payloads[i]);
+		entry->payloads[entry->num_payloads++] = payload;
+	}
+	return true;
 }
 
 void a9l_config_entry_destroy(a9l_config_entry *entry)
 {
-	free(entry->payload);
+	for (size_t i = 0; i < entry->num_loads; ++i)
+	{
+		a9l_config_load_destroy(&entry->loads[i]);
+	}
+	free(entry->loads);
+	for (size_t i = 0; i < entry->num_payloads; ++i)
+	{
+		free(entry->payloads[i]);
+	}
+	free(entry->payloads);
+	entry->payloads = NULL;
+	entry->num_payloads = 0;
 	entry->offset = 0;
 	entry->buttons = 0;
+	entry->loads = NULL;
+	entry->num_loads = 0;
+	free(entry->patch);
+	entry->patch = NULL;
+}
+
+bool a9l_config_load_initialize(a9l_config_load *load, const char *location, size_t offset, uint32_t address)
+{
+	load->location = malloc(strlen(location) + 1);
+	load->offset = offset;
+	load->address = address;
+	if (!load->location)
+		return false;
+
+	strcpy(load->location, location);
+	return true;
+}
+
+void a9l_config_load_destroy(a9l_config_load *load)
+{
+	free(load->location);
+	load->location = NULL;
+	load->offset = 0;
+	load->address = 0;
 }
 
 bool a9l_config_read_json(a9l_config *config, const char *json)
@@ -115,16 +201,31 @@ bool a9l_config_read_json(a9l_config *config, const char *json)
 	jsmntok_t *tokens;
 	jsmn_init(&parser);
 
-	int toks = jsmn_parse(&parser, json, strlen(json), NULL, 0);
-	if (toks == JSMN_ERROR_INVAL)
+	//Bound the size before the counting pass, which is linear in it
+	size_t json_size = strnlen(json, A9L_CONFIG_MAX_SIZE + 1);
+	if (json_size > A9L_CONFIG_MAX_SIZE)
+	{
+		return false;
+	}
+
+	int toks = jsmn_parse(&parser, json, json_size, NULL, 0);
+	if (toks <= 0 || (unsigned int)toks > A9L_CONFIG_MAX_TOKENS)
 	{
 		return false;
 	}
 
 	tokens = malloc(sizeof(jsmntok_t) * (unsigned int)toks);
+	if (!tokens)
+	{
+		return false;
+	}
 
 	jsmn_init(&parser);
-	jsmn_parse(&parser, json, strlen(json), tokens, (unsigned int)toks);
+	if (jsmn_parse(&parser, json, json_size, tokens, (unsigned int)toks) != toks)
+	{
+		free(tokens);
+		return false;
+	}
 
 	if (!validate_json_tokens(json, tokens, (unsigned int)toks))
 	{
@@ -170,6 +271,53 @@ static bool check_all_mandatory_found(const a9l_option list[], bool found_list[]
 	return found;
 }
 
+static bool check_string_token(const jsmntok_t *token)
+{
+	return token->type == JSMN_STRING &&
+		token->end >= token->start &&
+		(size_t)(token->end - token->start) <= A9L_CONFIG_MAX_STRING;
+}
+
+static bool validate_json_load_token(const char* json, const jsmntok_t *tokens, size_t amount, size_t *current_element)
+{
+	size_t i = *current_element;
+
+	bool found_list[ARRAY_SIZE(accepted_load_options)] = { 0 };
+
+	//Should be the object wrapping a load
+	if (++i >= amount || tokens[i].type != JSMN_OBJECT)
+		return false;
+
+	size_t number_of_options = (size_t)tokens[i].size;
+	if (number_of_options > ARRAY_SIZE(accepted_load_options))
+		return false;
+
+	for (size_t option = 0; option < number_of_options; ++option)
+	{
+		//Should be "location", "offset", or "address"
+		if (++i >= amount || !check_string_token(&tokens[i]))
+			return false;
+
+		if (!check_match(accepted_load_options, found_list, ARRAY_SIZE(accepted_load_options), &json[tokens[i].start]))
+			return false;
+
+		if (strncmp("location", &json[tokens[i].start], 8) == 0)
+		{
+			if (++i >= amount || !check_string_token(&tokens[i]))
+				return false;
+		}
+		else //offset or address, both numbers
+		{
+			if (++i >= amount || tokens[i].type != JSMN_PRIMITIVE)
+				return false;
+		}
+	}
+
+	*current_element = i;
+
+	return check_all_mandatory_found(accepted_load_options, found_list, ARRAY_SIZE(accepted_load_options));
+}
+
 static bool validate_json_entry_token(const char* json, const jsmntok_t *tokens, size_t amount, size_t *current_element)
 {
 	size_t i = *current_element;
@@ -183,32 +331,47 @@ static bool validate_json_entry_token(const char* json, const jsmntok_t *tokens,
 		return false;
 
 	size_t number_of_options = (size_t)tokens[i].size;
-	if (number_of_options < 3)
+	if (number_of_options < 3 || number_of_options > ARRAY_SIZE(accepted_options))
 		return false;
 
 	for (size_t option = 0; option < number_of_options; ++option)
 	{
-		//Should be "name", "location", "offset". or "buttons"
-		if (++i >= amount ||
-			tokens[i].type != JSMN_STRING)
+		//Should be "name", "location", "offset", "buttons", "loads", or "patch"
+		if (++i >= amount || !check_string_token(&tokens[i]))
 			return false;
 
 		if (!check_match(accepted_options, found_list, ARRAY_SIZE(accepted_options), &json[tokens[i].start]))
 			return false;
 
-		if (strncmp("name", &json[tokens[i].start], 4) == 0)
+		if (strncmp("name", &json[tokens[i].start], 4) == 0 ||
+			strncmp("patch", &json[tokens[i].start], 5) == 0)
 		{
-			//This is the actual name of the entry
-			if (++i >= amount || tokens[i].type != JSMN_STRING)
+			//This is the actual name of the entry, or the path to its patch
+			if (++i >= amount || !check_string_token(&tokens[i]))
 				return false;
 
 		}
 		else if (strncmp("location", &json[tokens[i].start], 8) == 0)
 		{
-			//Should be the actual location of the entry
-			if (++i >= amount || tokens[i].type != JSMN_STRING)
+			//Should be the actual location of the entry, or an array of
+			//locations to try in order
+			if (++i >= amount)
 				return false;
 
+			if (tokens[i].type == JSMN_ARRAY)
+			{
+				size_t location_count = (size_t)tokens[i].size;
+				if (location_count == 0 || location_count > A9L_CONFIG_MAX_LOCATIONS)
+					return false;
+
+				for (size_t k = 0; k < location_count; ++k)
+				{
+					if (++i >= amount || !check_string_token(&tokens[i]))
+						return false;
+				}
+			}
+			else if (!check_string_token(&tokens[i]))
+				return false;
 		}
 		else if (strncmp("buttons", &json[tokens[i].start], 7) == 0)
 		{
@@ -217,11 +380,29 @@ static bool validate_json_entry_token(const char* json, const jsmntok_t *tokens,
 				return false;
 
 			size_t button_count = (size_t)tokens[i].size;
+			if (button_count > A9L_CONFIG_MAX_BUTTONS)
+				return false;
 
 			for (size_t k = 0; k < button_count; ++k)
 			{
 				//Should be a string from a pre-determined set
-				if (++i >= amount || tokens[i].type != JSMN_STRING)
+				if (++i >= amount || !check_string_token(&tokens[i]))
+					return false;
+			}
+		}
+		else if (strncmp("loads", &json[tokens[i].start], 5) == 0)
+		{
+			//Should be an array of load objects
+			if (++i >= amount || tokens[i].type != JSMN_ARRAY)
+				return false;
+
+			size_t load_count = (size_t)tokens[i].size;
+			if (load_count > A9L_CONFIG_MAX_LOADS)
+				return false;
+
+			for (size_t k = 0; k < load_count; ++k)
+			{
+				if (!validate_json_load_token(json, tokens, amount, &i))
 					return false;
 			}
 		}
@@ -257,6 +438,8 @@ static bool validate_json_tokens(const char* json, const jsmntok_t *tokens, size
 		return false;
 
 	size_t array_size = (size_t)tokens[i].size;
+	if (array_size > A9L_CONFIG_MAX_ENTRIES)
+		return false;
 
 	for (size_t j = 0; j < array_size; ++j)
 	{
@@ -271,6 +454,9 @@ static char *token_extract_string(const char *json, const jsmntok_t *token)
 {
 	size_t string_size = (size_t)token->end - (size_t)token->start;
 	char *string = malloc(string_size + 1);
+	if (!string)
+		return NULL;
+
 	memcpy(string, &json[token->start], string_size);
 	string[string_size] = '\0';
 	return string;
@@ -281,6 +467,11 @@ static long token_extract_long(const char *json, const jsmntok_t *token, char**
 	return strtol(&json[token->start], end, 0);
 }
 
+static unsigned long token_extract_unsigned_long(const char *json, const jsmntok_t *token, char** end)
+{
+	return strtoul(&json[token->start], end, 0);
+}
+
 static bool token_extract_button(const char *json, const jsmntok_t *token, ctr_hid_button_type *button)
 {
 	const size_t button_strings_size = sizeof(button_strings)/sizeof(const char *);
@@ -297,15 +488,90 @@ static bool token_extract_button(const char *json, const jsmntok_t *token, ctr_h
 	return false;
 }
 
+static void free_locations(char *locations[], size_t num_locations)
+{
+	for (size_t i = 0; i < num_locations; ++i)
+	{
+		free(locations[i]);
+		locations[i] = NULL;
+	}
+}
+
+static void free_loads(a9l_config_load *loads, size_t num_loads)
+{
+	for (size_t i = 0; i < num_loads; ++i)
+	{
+		a9l_config_load_destroy(&loads[i]);
+	}
+	free(loads);
+}
+
+static bool parse_json_load_token(const char* json, const jsmntok_t *tokens, size_t *current_element, a9l_config_load *config_load)
+{
+	size_t i = *current_element;
+
+	char *location = NULL;
+	size_t offset = 0;
+	uint32_t address = 0;
+
+	size_t number_of_options = (size_t)tokens[i].size;
+
+	//The token counter points at the last token consumed at the end of every
+	//iteration, and at the end of the function
+	for (size_t option = 0; option < number_of_options; ++option)
+	{
+		const char *key = &json[tokens[++i].start];
+		++i;
+		if (strncmp("location", key, 8) == 0)
+		{
+			free(location);
+			location = token_extract_string(json, &tokens[i]);
+			if (!location)
+				return false;
+		}
+		else //due to the earlier checks, this has to be offset or address
+		{
+			char *end = NULL;
+			unsigned long value = token_extract_unsigned_long(json, &tokens[i], &end);
+			if (&json[tokens[i].end] != end)
+			{
+				free(location);
+				return false;
+			}
+
+			if (strncmp("offset", key, 6) == 0)
+				offset = (size_t)value;
+			else
+				address = (uint32_t)value;
+		}
+	}
+
+	if (!location)
+		return false;
+
+	bool res = a9l_config_load_initialize(config_load, location, offset, address);
+	free(location);
+	if (!res)
+		return false;
+
+	*current_element = i;
+
+	return true;
+}
+
 static bool parse_json_entry_token(const char* json, const jsmntok_t *tokens, size_t *current_element, a9l_config_entry *config_entry)
 {
 	size_t i = *current_element;
 
 	//Mandatory entries: name, location, buttons(for now)
 	//const char *name;
-	char *location = NULL;
+	char *locations[A9L_CONFIG_MAX_LOCATIONS] = { NULL };
+	size_t num_locations = 0;
 	ctr_hid_button_type buttons = CTR_HID_NONE;
 	size_t offset = 0;
+	a9l_config_load *loads = NULL;
+	size_t num_loads = 0;
+	char *patch = NULL;
 
 	size_t number_of_entries = (size_t)tokens[i++].size;
 
@@ -320,7 +586,32 @@ static bool parse_json_entry_token(const char* json, const jsmntok_t *tokens, si
 		}
 		else if (strncmp("location", key, 8) == 0)
 		{
-			location = token_extract_string(json, &tokens[i]);
+			free_locations(locations, num_locations);
+			if (tokens[i].type == JSMN_ARRAY)
+			{
+				num_locations = (size_t)tokens[i++].size;
+				for (size_t k = 0; k < num_locations; ++k)
+				{
+					locations[k] = token_extract_string(json, &tokens[i+k]);
+				}
+				i += (num_locations-1);
+			}
+			else
+			{
+				num_locations = 1;
+				locations[0] = token_extract_string(json, &tokens[i]);
+			}
+
+			for (size_t k = 0; k < num_locations; ++k)
+			{
+				if (!locations[k])
+				{
+					free_locations(locations, num_locations);
+					free_loads(loads, num_loads);
+					free(patch);
+					return false;
+				}
+			}
 		}
 		else if (strncmp("buttons", key, 7) == 0)
 		{
@@ -331,7 +622,9 @@ static bool parse_json_entry_token(const char* json, const jsmntok_t *tokens, si
 				ctr_hid_button_type button;
 				if (!token_extract_button(json, &tokens[i+k], &button))
 				{
-					free(location);
+					free_locations(locations, num_locations);
+					free_loads(loads, num_loads);
+					free(patch);
 					return false;
 				}
 				buttons |= button;
@@ -339,20 +632,67 @@ static bool parse_json_entry_token(const char* json, const jsmntok_t *tokens, si
 			if (button_count)
 				i += (button_count-1);
 		}
+		else if (strncmp("patch", key, 5) == 0)
+		{
+			free(patch);
+			patch = token_extract_string(json, &tokens[i]);
+			if (!patch)
+			{
+				free_locations(locations, num_locations);
+				free_loads(loads, num_loads);
+				return false;
+			}
+		}
+		else if (strncmp("loads", key, 5) == 0)
+		{
+			size_t load_count = (size_t)tokens[i].size;
+			free_loads(loads, num_loads);
+			loads = malloc(sizeof(a9l_config_load) * load_count);
+			num_loads = 0;
+			if (load_count && !loads)
+			{
+				free_locations(locations, num_locations);
+				free(patch);
+				return false;
+			}
+
+			for (size_t k = 0; k < load_count; ++k, ++num_loads)
+			{
+				++i;
+				if (!parse_json_load_token(json, tokens, &i, &loads[k]))
+				{
+					free_locations(locations, num_locations);
+					free_loads(loads, num_loads);
+					free(patch);
+					return false;
+				}
+			}
+		}
 		else //due to the earlier checks, this has to be offset
 		{
 			char *end = NULL;
 			offset = (size_t)token_extract_long(json, &tokens[i], &end);
 			if (&json[tokens[i].end] != end)
 			{
-				free(location);
+				free_locations(locations, num_locations);
+				free_loads(loads, num_loads);
+				free(patch);
 				return false;
 			}
 		}
 	}
 
-	a9l_config_entry_initialize(config_entry, location, offset, buttons);
-	free(location);
+	bool res = a9l_config_entry_initialize(config_entry, locations, num_locations, offset, buttons);
+	free_locations(locations, num_locations);
+	if (!res)
+	{
+		free_loads(loads, num_loads);
+		free(patch);
+		return false;
+	}
+	config_entry->loads = loads;
+	config_entry->num_loads = num_loads;
+	config_entry->patch = patch;
 
 	*current_element = i;
 
@@ -370,6 +710,8 @@ static bool parse_json_tokens(const char* json, const jsmntok_t *tokens, a9l_con
 	size_t array_size = (size_t)tokens[i++].size;
 
 	a9l_config_initialize(config, array_size);
+	if (array_size && !config->entries)
+		return false;
 
 	for (size_t j = 0; j < array_size; ++j)
 	{
@@ -11,13 +11,42 @@
 
 #include <ctr9/ctr_hid.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+//Hard limits on what a configuration may contain. The configuration comes from
+//user storage, so these keep a malformed or malicious file from making parsing
+//arbitrarily expensive. They are checked before any per-token work is done,
+//and sized for real configurations: a few hundred entries fit comfortably.
+//jsmn must be built with JSMN_PARENT_LINKS, or parsing is quadratic in the
+//number of tokens even within these limits.
+#define A9L_CONFIG_MAX_SIZE (64u * 1024u)
+#define A9L_CONFIG_MAX_TOKENS (16u * 1024u)
+#define A9L_CONFIG_MAX_ENTRIES 512u
+#define A9L_CONFIG_MAX_STRING 255u
+#define A9L_CONFIG_MAX_BUTTONS 16u
+#define A9L_CONFIG_MAX_LOADS 8u
+#define A9L_CONFIG_MAX_LOCATIONS 8u
+
+//An additional image to place in memory before jumping to the payload
 typedef struct
 {
-	char *payload;
+	char *location;
+	size_t offset;
+	uint32_t address;
+} a9l_config_load;
+
+typedef struct
+{
+	//Candidate locations for the payload, in the order they should be tried
+	char **payloads;
+	size_t num_payloads;
 	size_t offset;
 	ctr_hid_button_type buttons;
+	a9l_config_load *loads;
+	size_t num_loads;
+	//IPS patch to apply to the payload as it is loaded, NULL if none
+	char *patch;
 } a9l_config_entry;
 
 typedef struct
@@ -35,8 +64,16 @@ a9l_config_entry* a9l_config_get_entry(const a9l_config *config, size_t entry);
 
 size_t a9l_config_get_number_of_entries(const a9l_config *config);
 
-void a9l_config_entry_initialize(a9l_config_entry *entry, const char *payload, size_t offset, ctr_hid_button_type buttons);
+//The first entry for exactly these buttons, NULL if there is none
+a9l_config_entry* a9l_config_find_entry(const a9l_config *config, ctr_hid_button_type buttons);
+
+//Copies the payload locations. Returns false if out of memory.
+bool a9l_config_entry_initialize(a9l_config_entry *entry, char * const payloads[], size_t num_payloads, size_t offset, ctr_hid_button_type buttons);
 void a9l_config_entry_destroy(a9l_config_entry *entry);
 
+//Copies the location. Returns false if out of memory.
+bool a9l_config_load_initialize(a9l_config_load *load, const char *location, size_t offset, uint32_t address);
+void a9l_config_load_destroy(a9l_config_load *load);
+
 #endif//A9L_CONFIG_H_
 
@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_location.h"
+#include "a9l_trace.h"
+
+#include <ctr9/io/ctr_drives.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static uint32_t locations_hash(char * const locations[], size_t number_of_locations);
+
+const char *a9l_location_find_file(const char *path, const char * const drives[], size_t number_of_drives)
+{
+	for (size_t i = 0; i < number_of_drives; ++i)
+	{
+		a9l_trace_chdrive(drives[i]);
+		struct stat st;
+		if (a9l_trace_stat(path, &st) == 0)
+		{
+			return drives[i];
+		}
+	}
+	return NULL;
+}
+
+bool a9l_location_resolve(const char *location, const char *default_drive, char *resolved, size_t resolved_size)
+{
+	const char *path = location;
+	const char *colon = strchr(location, ':');
+	char drive[16];
+	const char *drives[] = { default_drive };
+
+	//Locations without a drive are relative to the configuration's drive
+	if (colon)
+	{
+		size_t drive_size = (size_t)(colon - location) + 1;
+		if (drive_size >= sizeof(drive))
+			return false;
+		memcpy(drive, location, drive_size);
+		drive[drive_size] = '\0';
+
+		drives[0] = drive;
+		path = colon + 1;
+	}
+
+	const char *found = a9l_location_find_file(path, drives, 1);
+
+	if (!found)
+		return false;
+
+	//Relative to the root of the drive, whatever its current directory is
+	const char *separator = path[0] == '/' ? "" : "/";
+	int written = snprintf(resolved, resolved_size, "%s%s%s", found, separator, path);
+	return written > 0 && (size_t)written < resolved_size;
+}
+
+size_t a9l_location_find(char * const locations[], size_t number_of_locations, size_t first, const char *default_drive, char *resolved, size_t resolved_size)
+{
+	if (first < number_of_locations && a9l_location_resolve(locations[first], default_drive, resolved, resolved_size))
+		return first;
+
+	for (size_t i = 0; i < number_of_locations; ++i)
+	{
+		if (i != first && a9l_location_resolve(locations[i], default_drive, resolved, resolved_size))
+			return i;
+	}
+	return number_of_locations;
+}
+
+size_t a9l_location_find_remembered(a9l_memo *memo, char * const locations[], size_t number_of_locations, const char *default_drive, char *resolved, size_t resolved_size)
+{
+	bool use_memo = number_of_locations > 1;
+	uint32_t key = locations_hash(locations, number_of_locations);
+	uint32_t remembered;
+	size_t first = 0;
+	if (use_memo && a9l_memo_lookup(memo, key, &remembered))
+	{
+		for (size_t i = 0; i < number_of_locations; ++i)
+		{
+			if (a9l_memo_hash(A9L_MEMO_HASH_INIT, locations[i]) == remembered)
+			{
+				first = i;
+				break;
+			}
+		}
+	}
+
+	size_t found = a9l_location_find(locations, number_of_locations, first, default_drive, resolved, resolved_size);
+	if (use_memo && found != number_of_locations)
+	{
+		a9l_memo_update(memo, key, a9l_memo_hash(A9L_MEMO_HASH_INIT, locations[found]));
+	}
+	return found;
+}
+
+//Helper functions follow
+
+static uint32_t locations_hash(char * const locations[], size_t number_of_locations)
+{
+	uint32_t hash = A9L_MEMO_HASH_INIT;
+	for (size_t i = 0; i < number_of_locations; ++i)
+	{
+		hash = a9l_memo_hash(hash, locations[i]);
+	}
+	return hash;
+}
+
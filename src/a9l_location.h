@@ -0,0 +1,36 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_LOCATION_H_
+#define A9L_LOCATION_H_
+
+#include "a9l_memo.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+//Finds the first drive, in order, that has a file at path, and leaves it as
+//the current drive. Returns NULL if none of them do.
+const char *a9l_location_find_file(const char *path, const char * const drives[], size_t number_of_drives);
+
+//Resolves a configuration location to a full path, e.g. "SD:/a.bin", and
+//checks that the file exists. Locations without a drive are relative to
+//default_drive. Fails if the file doesn't exist or the path doesn't fit.
+bool a9l_location_resolve(const char *location, const char *default_drive, char *resolved, size_t resolved_size);
+
+//Tries the candidate at first before the rest, in order. Returns the index of
+//the candidate found, or number_of_locations if none exist.
+size_t a9l_location_find(char * const locations[], size_t number_of_locations, size_t first, const char *default_drive, char *resolved, size_t resolved_size);
+
+//Like a9l_location_find, starting with the candidate memo says worked last
+//time for this list of locations, and remembering the one found. A single
+//location doesn't need the memo.
+size_t a9l_location_find_remembered(a9l_memo *memo, char * const locations[], size_t number_of_locations, const char *default_drive, char *resolved, size_t resolved_size);
+
+#endif//A9L_LOCATION_H_
+
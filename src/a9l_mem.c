@@ -0,0 +1,202 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_mem.h"
+
+#include <stdint.h>
+
+//Words may alias anything they are copied from or to
+typedef uint32_t __attribute__((may_alias)) mem_word;
+
+//Eight registers' worth, one LDM/STM pair
+#define BLOCK_SIZE 32u
+#define WORD_MASK 3u
+
+static void copy_blocks(mem_word *dest, const mem_word *src, size_t blocks);
+static void fill_blocks(mem_word *dest, mem_word word, size_t blocks);
+
+void a9l_mem_copy(void *dest, const void *src, size_t size)
+{
+	uint8_t *dst = dest;
+	const uint8_t *source = src;
+
+	if (((uintptr_t)dst ^ (uintptr_t)source) & WORD_MASK)
+	{
+		a9l_mem_copy_reference(dst, source, size);
+		return;
+	}
+
+	while (size && ((uintptr_t)dst & WORD_MASK))
+	{
+		*dst++ = *source++;
+		size--;
+	}
+
+	size_t blocks = size / BLOCK_SIZE;
+	if (blocks)
+	{
+		copy_blocks((void*)dst, (const void*)source, blocks);
+		dst += blocks * BLOCK_SIZE;
+		source += blocks * BLOCK_SIZE;
+		size -= blocks * BLOCK_SIZE;
+	}
+
+	mem_word *dst_word = (void*)dst;
+	const mem_word *source_word = (const void*)source;
+	for (; size >= sizeof(mem_word); size -= sizeof(mem_word))
+	{
+		*dst_word++ = *source_word++;
+	}
+
+	a9l_mem_copy_reference(dst_word, source_word, size);
+}
+
+void a9l_mem_zero(void *dest, size_t size)
+{
+	a9l_mem_fill(dest, 0, size);
+}
+
+void a9l_mem_fill(void *dest, int value, size_t size)
+{
+	uint8_t byte = (uint8_t)value;
+	uint8_t *dst = dest;
+	while (size && ((uintptr_t)dst & WORD_MASK))
+	{
+		*dst++ = byte;
+		size--;
+	}
+
+	mem_word word = 0x01010101u * byte;
+	size_t blocks = size / BLOCK_SIZE;
+	if (blocks)
+	{
+		fill_blocks((void*)dst, word, blocks);
+		dst += blocks * BLOCK_SIZE;
+		size -= blocks * BLOCK_SIZE;
+	}
+
+	mem_word *dst_word = (void*)dst;
+	for (; size >= sizeof(mem_word); size -= sizeof(mem_word))
+	{
+		*dst_word++ = word;
+	}
+
+	a9l_mem_fill_reference(dst_word, byte, size);
+}
+
+void a9l_mem_copy_volatile(volatile void *dest, const volatile void *src, size_t size)
+{
+	if (!(((uintptr_t)dest | (uintptr_t)src | size) & WORD_MASK))
+	{
+		volatile uint32_t *dst = dest;
+		const volatile uint32_t *source = src;
+		for (size_t i = 0; i < size / sizeof(uint32_t); ++i)
+			dst[i] = source[i];
+		return;
+	}
+
+	volatile uint8_t *dst = dest;
+	const volatile uint8_t *source = src;
+	for (size_t i = 0; i < size; ++i)
+		dst[i] = source[i];
+}
+
+void a9l_mem_copy_reference(void *dest, const void *src, size_t size)
+{
+	uint8_t *dst = dest;
+	const uint8_t *source = src;
+	while (size--)
+		*dst++ = *source++;
+}
+
+void a9l_mem_zero_reference(void *dest, size_t size)
+{
+	a9l_mem_fill_reference(dest, 0, size);
+}
+
+void a9l_mem_fill_reference(void *dest, int value, size_t size)
+{
+	uint8_t *dst = dest;
+	while (size--)
+		*dst++ = (uint8_t)value;
+}
+
+//Helper functions follow
+
+#if defined(__arm__) && !defined(__thumb__)
+
+static void copy_blocks(mem_word *dest, const mem_word *src, size_t blocks)
+{
+	__asm__ volatile(
+		"1:\n\t"
+		"ldmia %[src]!, {r3-r10}\n\t"
+		"stmia %[dest]!, {r3-r10}\n\t"
+		"subs %[blocks], %[blocks], #1\n\t"
+		"bne 1b\n\t"
+		: [dest] "+r" (dest), [src] "+r" (src), [blocks] "+r" (blocks)
+		:
+		: "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "cc", "memory");
+}
+
+static void fill_blocks(mem_word *dest, mem_word word, size_t blocks)
+{
+	__asm__ volatile(
+		"mov r3, %[word]\n\t"
+		"mov r4, %[word]\n\t"
+		"mov r5, %[word]\n\t"
+		"mov r6, %[word]\n\t"
+		"mov r7, %[word]\n\t"
+		"mov r8, %[word]\n\t"
+		"mov r9, %[word]\n\t"
+		"mov r10, %[word]\n\t"
+		"1:\n\t"
+		"stmia %[dest]!, {r3-r10}\n\t"
+		"subs %[blocks], %[blocks], #1\n\t"
+		"bne 1b\n\t"
+		: [dest] "+r" (dest), [blocks] "+r" (blocks)
+		: [word] "r" (word)
+		: "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "cc", "memory");
+}
+
+#else
+
+static void copy_blocks(mem_word *dest, const mem_word *src, size_t blocks)
+{
+	while (blocks--)
+	{
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest[3] = src[3];
+		dest[4] = src[4];
+		dest[5] = src[5];
+		dest[6] = src[6];
+		dest[7] = src[7];
+		dest += 8;
+		src += 8;
+	}
+}
+
+static void fill_blocks(mem_word *dest, mem_word word, size_t blocks)
+{
+	while (blocks--)
+	{
+		dest[0] = word;
+		dest[1] = word;
+		dest[2] = word;
+		dest[3] = word;
+		dest[4] = word;
+		dest[5] = word;
+		dest[6] = word;
+		dest[7] = word;
+		dest += 8;
+	}
+}
+
+#endif
+
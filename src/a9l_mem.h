@@ -0,0 +1,36 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_MEM_H_
+#define A9L_MEM_H_
+
+#include <stddef.h>
+
+//Copy and fill kernels for the load paths. When both pointers can be word
+//aligned together, the bulk is moved 32 bytes at a time with LDM/STM on ARM
+//(or an unrolled word loop elsewhere), with byte copies for the unaligned head
+//and the tail. Otherwise they fall back to copying bytes. Regions passed to
+//a9l_mem_copy must not overlap.
+
+void a9l_mem_copy(void *dest, const void *src, size_t size);
+void a9l_mem_zero(void *dest, size_t size);
+
+//Sets size bytes at dest to value, like memset
+void a9l_mem_fill(void *dest, int value, size_t size);
+
+//For copies to or from registers. Uses word accesses when both pointers are
+//word aligned and size is a multiple of 4, single bytes otherwise.
+void a9l_mem_copy_volatile(volatile void *dest, const volatile void *src, size_t size);
+
+//Byte at a time versions, to check the above against
+void a9l_mem_copy_reference(void *dest, const void *src, size_t size);
+void a9l_mem_zero_reference(void *dest, size_t size);
+void a9l_mem_fill_reference(void *dest, int value, size_t size);
+
+#endif//A9L_MEM_H_
+
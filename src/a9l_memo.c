@@ -0,0 +1,180 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_memo.h"
+#include "a9l_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_records;
+	uint32_t has_selection;
+} memo_header;
+
+void a9l_memo_initialize(a9l_memo *memo)
+{
+	memo->num_records = 0;
+	memo->has_selection = false;
+	memo->dirty = false;
+}
+
+bool a9l_memo_read(a9l_memo *memo, const char *path)
+{
+	a9l_memo_initialize(memo);
+
+	FILE *file = a9l_trace_fopen(path, "rb");
+	if (!file)
+		return false;
+
+	memo_header header;
+	bool res = 1 == a9l_trace_fread(&header, sizeof(header), 1, file) &&
+		header.magic == A9L_MEMO_MAGIC &&
+		header.version == A9L_MEMO_VERSION &&
+		header.num_records <= A9L_MEMO_MAX_RECORDS;
+
+	if (res && header.num_records)
+	{
+		res = header.num_records == a9l_trace_fread(memo->records, sizeof(a9l_memo_record), header.num_records, file);
+	}
+	if (res && header.has_selection)
+	{
+		a9l_memo_selection *selection = &memo->selection;
+		res = 1 == a9l_trace_fread(selection, sizeof(*selection), 1, file) &&
+			selection->num_loads <= A9L_MEMO_MAX_LOADS;
+
+		//Strings come from storage, make sure they are terminated
+		selection->payload[A9L_MEMO_PATH_SIZE - 1] = '\0';
+		selection->patch[A9L_MEMO_PATH_SIZE - 1] = '\0';
+		for (size_t i = 0; i < A9L_MEMO_MAX_LOADS; ++i)
+			selection->loads[i].location[A9L_MEMO_PATH_SIZE - 1] = '\0';
+	}
+	a9l_trace_fclose(file);
+
+	memo->num_records = res ? header.num_records : 0;
+	memo->has_selection = res && header.has_selection;
+	return res;
+}
+
+bool a9l_memo_write(a9l_memo *memo, const char *path)
+{
+	if (!memo->dirty)
+		return true;
+
+	FILE *file = a9l_trace_fopen(path, "wb");
+	if (!file)
+		return false;
+
+	memo_header header = { A9L_MEMO_MAGIC, A9L_MEMO_VERSION, (uint16_t)memo->num_records, memo->has_selection };
+	bool res = 1 == a9l_trace_fwrite(&header, sizeof(header), 1, file);
+	if (res && memo->num_records)
+	{
+		res = 1 == a9l_trace_fwrite(memo->records, sizeof(a9l_memo_record) * memo->num_records, 1, file);
+	}
+	if (res && memo->has_selection)
+	{
+		res = 1 == a9l_trace_fwrite(&memo->selection, sizeof(memo->selection), 1, file);
+	}
+	res = a9l_trace_fclose(file) == 0 && res;
+
+	memo->dirty = !res;
+	return res;
+}
+
+bool a9l_memo_lookup(const a9l_memo *memo, uint32_t entry, uint32_t *location)
+{
+	for (size_t i = 0; i < memo->num_records; ++i)
+	{
+		if (memo->records[i].entry == entry)
+		{
+			*location = memo->records[i].location;
+			return true;
+		}
+	}
+	return false;
+}
+
+void a9l_memo_update(a9l_memo *memo, uint32_t entry, uint32_t location)
+{
+	for (size_t i = 0; i < memo->num_records; ++i)
+	{
+		if (memo->records[i].entry == entry)
+		{
+			if (memo->records[i].location != location)
+			{
+				memo->records[i].location = location;
+				memo->dirty = true;
+			}
+			return;
+		}
+	}
+
+	//Not found, drop the oldest record if full
+	if (memo->num_records == A9L_MEMO_MAX_RECORDS)
+	{
+		memmove(&memo->records[0], &memo->records[1], sizeof(a9l_memo_record) * (A9L_MEMO_MAX_RECORDS - 1));
+		memo->num_records--;
+	}
+
+	memo->records[memo->num_records].entry = entry;
+	memo->records[memo->num_records].location = location;
+	memo->num_records++;
+	memo->dirty = true;
+}
+
+const a9l_memo_selection *a9l_memo_find_selection(const a9l_memo *memo, uint32_t config, uint32_t buttons)
+{
+	if (memo->has_selection && memo->selection.config == config && memo->selection.buttons == buttons)
+		return &memo->selection;
+	return NULL;
+}
+
+void a9l_memo_set_selection(a9l_memo *memo, const a9l_memo_selection *selection)
+{
+	if (memo->has_selection && memcmp(&memo->selection, selection, sizeof(*selection)) == 0)
+		return;
+
+	memo->selection = *selection;
+	memo->has_selection = true;
+	memo->dirty = true;
+}
+
+uint32_t a9l_memo_hash(uint32_t hash, const char *string)
+{
+	while (*string)
+	{
+		hash ^= (uint8_t)*string++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t a9l_memo_hash_word(uint32_t hash, uint32_t word)
+{
+	for (size_t i = 0; i < 4; ++i)
+	{
+		hash ^= (uint8_t)(word >> (8 * i));
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t a9l_memo_hash_data(uint32_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_MEMO_H_
+#define A9L_MEMO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//Small persisted record of which candidate location worked last time for each
+//configuration entry, so the usual boot only has to probe once. Entries and
+//locations are identified by hashes of their strings, so editing the
+//configuration simply invalidates the affected records.
+//
+//The memo also holds the last boot's resolved selection: which buttons were
+//held, which configuration file it came from, and the arguments that were
+//passed to the bootloader. A boot with the same buttons and a configuration
+//with the same contents can then skip parsing the configuration. Boots that do
+//are only counted in traces, so a boot that changes nothing doesn't write the
+//memo.
+
+#define A9L_MEMO_FILE "SD:/arm9launcher.mem"
+#define A9L_MEMO_MAGIC 0x4D4C3941u //"A9LM"
+#define A9L_MEMO_VERSION 4u
+#define A9L_MEMO_MAX_RECORDS 16u
+#define A9L_MEMO_PATH_SIZE 256u
+#define A9L_MEMO_MAX_LOADS 8u
+
+typedef struct
+{
+	uint32_t entry;
+	uint32_t location;
+} a9l_memo_record;
+
+typedef struct
+{
+	char location[A9L_MEMO_PATH_SIZE];
+	uint32_t offset;
+	uint32_t address;
+} a9l_memo_load;
+
+typedef struct
+{
+	//Hash of the configuration's drive and contents
+	uint32_t config;
+	uint32_t buttons;
+	char payload[A9L_MEMO_PATH_SIZE];
+	uint32_t offset;
+	char patch[A9L_MEMO_PATH_SIZE];
+	uint32_t num_loads;
+	a9l_memo_load loads[A9L_MEMO_MAX_LOADS];
+} a9l_memo_selection;
+
+typedef struct
+{
+	a9l_memo_record records[A9L_MEMO_MAX_RECORDS];
+	size_t num_records;
+	a9l_memo_selection selection;
+	bool has_selection;
+	bool dirty;
+} a9l_memo;
+
+void a9l_memo_initialize(a9l_memo *memo);
+
+//Returns false, leaving the memo empty, if the file is missing or invalid
+bool a9l_memo_read(a9l_memo *memo, const char *path);
+
+//Only touches the file if something changed since it was read
+bool a9l_memo_write(a9l_memo *memo, const char *path);
+
+bool a9l_memo_lookup(const a9l_memo *memo, uint32_t entry, uint32_t *location);
+void a9l_memo_update(a9l_memo *memo, uint32_t entry, uint32_t location);
+
+//Returns the remembered selection if it was made with the same buttons from
+//the same configuration, NULL otherwise.
+const a9l_memo_selection *a9l_memo_find_selection(const a9l_memo *memo, uint32_t config, uint32_t buttons);
+
+//selection should be zero initialized before being filled in, so unchanged
+//selections compare equal and don't cause a write.
+void a9l_memo_set_selection(a9l_memo *memo, const a9l_memo_selection *selection);
+
+//FNV-1a, continuing from a previous hash. Start with A9L_MEMO_HASH_INIT.
+#define A9L_MEMO_HASH_INIT 2166136261u
+uint32_t a9l_memo_hash(uint32_t hash, const char *string);
+uint32_t a9l_memo_hash_word(uint32_t hash, uint32_t word);
+uint32_t a9l_memo_hash_data(uint32_t hash, const void *data, size_t size);
+
+#endif//A9L_MEMO_H_
+
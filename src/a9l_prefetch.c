@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_prefetch.h"
+#include "a9l_trace.h"
+
+#include <string.h>
+
+void a9l_prefetch_start(a9l_prefetch *prefetch, a9l_resident *cache, const char *path)
+{
+	prefetch->active = false;
+	prefetch->cache = cache;
+	if (!path || strlen(path) >= sizeof(prefetch->path))
+		return;
+
+	FILE *file = a9l_trace_fopen(path, "rb");
+	if (!file)
+		return;
+
+	//Nothing to do after a soft reset that kept the payload
+	size_t cached_size;
+	struct stat *st = &prefetch->st;
+	if (a9l_trace_fstat(file, st) || !st->st_size || !st->st_mtime ||
+		(size_t)st->st_size > cache->capacity ||
+		a9l_resident_lookup(cache, path, file, st, &cached_size) ||
+		a9l_trace_fseek(file, 0, SEEK_SET))
+	{
+		a9l_trace_fclose(file);
+		return;
+	}
+
+	//The cache is only invalidated once the read has started, so a drive that
+	//can't read in the background leaves it as it was. A read that fails
+	//partway leaves data that doesn't match the digest, which is never used.
+	size_t size = (size_t)st->st_size;
+	if (!a9l_trace_fread_async(cache->data, size, file))
+	{
+		a9l_trace_fclose(file);
+		return;
+	}
+	a9l_resident_begin(cache, size);
+
+	strcpy(prefetch->path, path);
+	prefetch->file = file;
+	prefetch->size = size;
+	prefetch->active = true;
+}
+
+bool a9l_prefetch_finish(a9l_prefetch *prefetch, const char *path)
+{
+	if (!prefetch->active)
+		return false;
+	prefetch->active = false;
+
+	bool hit = path && strcmp(path, prefetch->path) == 0;
+	if (hit)
+		hit = a9l_trace_fwait(prefetch->file);
+	else
+		a9l_trace_fcancel(prefetch->file);
+	a9l_trace_fclose(prefetch->file);
+
+	if (hit)
+		a9l_resident_commit(prefetch->cache, prefetch->path, &prefetch->st, prefetch->size);
+	a9l_trace_prefetch(hit);
+	return hit;
+}
+
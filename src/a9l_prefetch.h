@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_PREFETCH_H_
+#define A9L_PREFETCH_H_
+
+#include "a9l_resident.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+//Speculative prefetch of the payload the last boot selected. Most boots pick
+//the same one, so the loader starts reading it into the resident cache before
+//the configuration is resolved, and the read goes on in the background while
+//it is. If the same payload is selected, the loader waits for the read and
+//commits it, and the bootloader finds the payload in the resident cache. If
+//not, the read is stopped and nothing is committed.
+//
+//The read is only started if the drive can transfer in the background, see
+//a9l_trace_fread_async; otherwise it would only make the boot slower.
+
+typedef struct
+{
+	FILE *file;
+	a9l_resident *cache;
+	char path[A9L_RESIDENT_PATH_SIZE];
+	struct stat st;
+	size_t size;
+	bool active;
+} a9l_prefetch;
+
+//Starts reading the file at path, if the cache doesn't already hold it. path
+//may be NULL when there is nothing to prefetch.
+void a9l_prefetch_start(a9l_prefetch *prefetch, a9l_resident *cache, const char *path);
+
+//Finishes the prefetch if path is the payload being read, or stops it if it
+//isn't. Returns whether the payload is now in the cache thanks to it.
+bool a9l_prefetch_finish(a9l_prefetch *prefetch, const char *path);
+
+#endif//A9L_PREFETCH_H_
+
@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_resident.h"
+#include "a9l_trace.h"
+
+#include <string.h>
+
+#define DATA_ALIGNMENT 32u
+
+static bool check_samples(const a9l_resident *cache, FILE *file, size_t size);
+static uint32_t digest(const void *data, size_t size);
+static uint32_t header_digest(const a9l_resident_header *header);
+
+void a9l_resident_initialize(a9l_resident *cache, void *region, size_t region_size)
+{
+	size_t data_offset = (sizeof(a9l_resident_header) + DATA_ALIGNMENT - 1) & ~(size_t)(DATA_ALIGNMENT - 1);
+	cache->header = region;
+	cache->data = (char*)region + data_offset;
+	cache->capacity = region_size > data_offset ? region_size - data_offset : 0;
+}
+
+void *a9l_resident_lookup(const a9l_resident *cache, const char *path, FILE *file, const struct stat *st, size_t *size)
+{
+	const a9l_resident_header *header = cache->header;
+	if (!cache->capacity || !st->st_mtime ||
+		header->magic != A9L_RESIDENT_MAGIC ||
+		header->header_digest != header_digest(header) ||
+		header->size > cache->capacity)
+		return NULL;
+
+	//Cheap identity checks before touching the data
+	if (header->file_size != (uint32_t)st->st_size ||
+		header->file_time != (uint32_t)st->st_mtime ||
+		strncmp(header->path, path, A9L_RESIDENT_PATH_SIZE) != 0)
+		return NULL;
+
+	if (!check_samples(cache, file, header->size) ||
+		header->digest != digest(cache->data, header->size))
+		return NULL;
+
+	*size = header->size;
+	return cache->data;
+}
+
+//On a miss the whole file is read into the cache, including parts that are
+//never loaded, like an ELF's section headers or what precedes a raw payload's
+//offset, and the loads are then copied out of the cache. So the first boot
+//with a new payload reads those extra parts and makes one extra copy in memory
+//of what is loaded. Later boots read just the sample blocks.
+void *a9l_resident_load(a9l_resident *cache, const char *path, FILE *file, size_t *size)
+{
+	struct stat st;
+	if (a9l_trace_fstat(file, &st))
+		return NULL;
+
+	void *image = a9l_resident_lookup(cache, path, file, &st, size);
+	if (image)
+		return image;
+
+	size_t file_size = (size_t)st.st_size;
+	image = a9l_resident_begin(cache, file_size);
+	if (!image || !file_size || !st.st_mtime)
+		return NULL;
+
+	if (a9l_trace_fseek(file, 0, SEEK_SET) || 1 != a9l_trace_fread(image, file_size, 1, file))
+		return NULL;
+
+	a9l_resident_commit(cache, path, &st, file_size);
+	*size = file_size;
+	return image;
+}
+
+void *a9l_resident_begin(a9l_resident *cache, size_t size)
+{
+	a9l_resident_invalidate(cache);
+	if (size > cache->capacity)
+		return NULL;
+	return cache->data;
+}
+
+void a9l_resident_commit(a9l_resident *cache, const char *path, const struct stat *st, size_t size)
+{
+	a9l_resident_header *header = cache->header;
+	if (size > cache->capacity || strlen(path) >= A9L_RESIDENT_PATH_SIZE || !st->st_mtime)
+		return;
+
+	memset(header->path, 0, A9L_RESIDENT_PATH_SIZE);
+	strcpy(header->path, path);
+	header->size = (uint32_t)size;
+	header->file_size = (uint32_t)st->st_size;
+	header->file_time = (uint32_t)st->st_mtime;
+	header->digest = digest(cache->data, size);
+	header->header_digest = header_digest(header);
+	header->magic = A9L_RESIDENT_MAGIC;
+}
+
+void a9l_resident_invalidate(a9l_resident *cache)
+{
+	if (cache->capacity)
+		cache->header->magic = 0;
+}
+
+//Helper functions follow
+
+static bool check_samples(const a9l_resident *cache, FILE *file, size_t size)
+{
+	char block[A9L_RESIDENT_SAMPLE_SIZE];
+	size_t amount = size < sizeof(block) ? size : sizeof(block);
+	for (size_t i = 0; i < A9L_RESIDENT_SAMPLES; ++i)
+	{
+		size_t offset = (size_t)((uint64_t)(size - amount) * i / (A9L_RESIDENT_SAMPLES - 1));
+		if (a9l_trace_fseek(file, (long)offset, SEEK_SET) ||
+			1 != a9l_trace_fread(block, amount, 1, file) ||
+			memcmp(block, cache->data + offset, amount) != 0)
+			return false;
+	}
+	return true;
+}
+
+//FNV-1a over 32 bit words. Meant to catch the region being overwritten or
+//decaying between boots, not deliberate tampering.
+static uint32_t digest(const void *data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	const uint8_t *bytes = data;
+	size_t words = size / 4;
+	for (size_t i = 0; i < words; ++i)
+	{
+		uint32_t word;
+		memcpy(&word, bytes + i * 4, sizeof(word));
+		hash ^= word;
+		hash *= 16777619u;
+	}
+
+	for (size_t i = words * 4; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash ^ (uint32_t)size;
+}
+
+static uint32_t header_digest(const a9l_resident_header *header)
+{
+	a9l_resident_header copy = *header;
+	copy.magic = A9L_RESIDENT_MAGIC;
+	copy.header_digest = 0;
+	return digest(&copy, sizeof(copy));
+}
+
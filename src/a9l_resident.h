@@ -0,0 +1,82 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_RESIDENT_H_
+#define A9L_RESIDENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+//Resident payload cache. Keeps the last payload file loaded in a reserved
+//region of FCRAM, which survives a soft reset, so the next boot can copy it
+//from memory instead of reading it from storage again. The region is passed in
+//so it can be any block of memory that persists between boots.
+//
+//The region starts with an a9l_resident_header, followed by the file data.
+//The header identifies the file by path, size and modification time, and holds
+//a digest of the data to catch the region having been overwritten.
+//
+//FAT only keeps modification times to 2 seconds, and a file can be replaced by
+//one of the same size and time, e.g. when extracted from an archive. So before
+//the copy is used, a few blocks spread over the file are read and compared
+//against it. Files without a modification time are never cached.
+
+//Between the end of the usual payload area and the stack, which grows down
+//from 0x27F00000.
+#define A9L_RESIDENT_ADDR 0x27000000u
+#define A9L_RESIDENT_SIZE 0x00E00000u
+
+#define A9L_RESIDENT_MAGIC 0x43523941u //"A9RC"
+#define A9L_RESIDENT_PATH_SIZE 256u
+
+//Blocks of the file compared against the copy before it is used, the first
+//and last among them
+#define A9L_RESIDENT_SAMPLES 4u
+#define A9L_RESIDENT_SAMPLE_SIZE 512u
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t size;
+	uint32_t file_size;
+	uint32_t file_time;
+	uint32_t digest;
+	uint32_t header_digest;
+	char path[A9L_RESIDENT_PATH_SIZE];
+} a9l_resident_header;
+
+typedef struct
+{
+	a9l_resident_header *header;
+	char *data;
+	size_t capacity;
+} a9l_resident;
+
+void a9l_resident_initialize(a9l_resident *cache, void *region, size_t region_size);
+
+//Returns the cached contents of file, opened from path, if they are valid and
+//the file described by st has not changed since. NULL otherwise. Moves the
+//file position.
+void *a9l_resident_lookup(const a9l_resident *cache, const char *path, FILE *file, const struct stat *st, size_t *size);
+
+//Returns the whole file out of the cache, reading all of it into the cache
+//first if it isn't there or is stale. NULL if it can't be cached.
+void *a9l_resident_load(a9l_resident *cache, const char *path, FILE *file, size_t *size);
+
+//Invalidates the cache and returns where size bytes of file data should be
+//written, or NULL if they don't fit. Call a9l_resident_commit once written.
+void *a9l_resident_begin(a9l_resident *cache, size_t size);
+void a9l_resident_commit(a9l_resident *cache, const char *path, const struct stat *st, size_t size);
+
+void a9l_resident_invalidate(a9l_resident *cache);
+
+#endif//A9L_RESIDENT_H_
+
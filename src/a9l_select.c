@@ -0,0 +1,175 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_select.h"
+#include "a9l_location.h"
+#include "a9l_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t config_identity(const char *drive, const char *config, size_t config_size);
+static bool set_load_arguments(a9l_select_load *arguments, const char *location, const char *drive, size_t offset, uint32_t address);
+static bool resolve_patch(const char *location, const char *drive, char *patch, size_t patch_size);
+static bool resolve_entry(a9l_selection *selection, a9l_memo *memo, const char *drive, const a9l_config_entry *entry, const char **error);
+static bool use_selection(a9l_selection *selection, const a9l_memo_selection *remembered, const char *drive);
+static void remember_selection(a9l_memo *memo, uint32_t config, ctr_hid_button_type buttons, const a9l_selection *selection, const a9l_config_entry *entry);
+
+bool a9l_select(a9l_selection *selection, a9l_memo *memo, const char *drive, const char *config, size_t config_size, ctr_hid_button_type buttons, const char **error)
+{
+	//Most boots select the same entry as last time. If the buttons and the
+	//configuration's contents are the same, reuse that selection instead of
+	//parsing the configuration again.
+	uint32_t config_id = config_identity(drive, config, config_size);
+	const a9l_memo_selection *remembered = a9l_memo_find_selection(memo, config_id, (uint32_t)buttons);
+	selection->remembered = remembered && use_selection(selection, remembered, drive);
+	a9l_trace_selection(selection->remembered);
+	if (selection->remembered)
+		return true;
+
+	a9l_config parsed = { 0 };
+	if (!a9l_config_read_json(&parsed, config))
+	{
+		*error = "Failed to parse JSON configuration file";
+		return false;
+	}
+
+	const a9l_config_entry *entry = a9l_config_find_entry(&parsed, buttons);
+	bool res = false;
+	if (!entry)
+	{
+		*error = "Failed to identify payload to launch";
+	}
+	else if ((res = resolve_entry(selection, memo, drive, entry, error)))
+	{
+		remember_selection(memo, config_id, buttons, selection, entry);
+	}
+
+	a9l_config_destroy(&parsed);
+	return res;
+}
+
+//Helper functions follow
+
+//The configuration is small, so hashing all of it is cheap next to parsing it,
+//and unlike its size and modification time it changes with any edit
+static uint32_t config_identity(const char *drive, const char *config, size_t config_size)
+{
+	uint32_t hash = a9l_memo_hash(A9L_MEMO_HASH_INIT, drive);
+	hash = a9l_memo_hash_word(hash, (uint32_t)config_size);
+	return a9l_memo_hash_data(hash, config, config_size);
+}
+
+//Load locations are resolved like the payload's, so the bootloader never
+//depends on which drive happens to be current. Fails if the file isn't there
+//or its full path doesn't fit.
+static bool set_load_arguments(a9l_select_load *arguments, const char *location, const char *drive, size_t offset, uint32_t address)
+{
+	if (!a9l_location_resolve(location, drive, arguments->location, sizeof(arguments->location)))
+		return false;
+	snprintf(arguments->offset, sizeof(arguments->offset), "%zu", offset);
+	snprintf(arguments->address, sizeof(arguments->address), "0x%08lX", (unsigned long)address);
+	return true;
+}
+
+//An empty location means there is no patch
+static bool resolve_patch(const char *location, const char *drive, char *patch, size_t patch_size)
+{
+	if (!location || !location[0])
+	{
+		patch[0] = '\0';
+		return true;
+	}
+	return a9l_location_resolve(location, drive, patch, patch_size);
+}
+
+static bool resolve_entry(a9l_selection *selection, a9l_memo *memo, const char *drive, const a9l_config_entry *entry, const char **error)
+{
+	//Try the location that worked last time first, so in the common case
+	//only one location is probed
+	size_t found = a9l_location_find_remembered(memo, entry->payloads, entry->num_payloads, drive, selection->payload, sizeof(selection->payload));
+	if (found == entry->num_payloads)
+	{
+		*error = "Unable to find payload file in any of its locations!";
+		return false;
+	}
+
+	selection->offset = entry->offset;
+
+	if (!resolve_patch(entry->patch, drive, selection->patch, sizeof(selection->patch)))
+	{
+		*error = "Unable to find the payload's patch file, or its path is too long!";
+		return false;
+	}
+
+	selection->num_loads = entry->num_loads;
+	for (size_t i = 0; i < entry->num_loads; ++i)
+	{
+		const a9l_config_load *load = &entry->loads[i];
+		if (!set_load_arguments(&selection->loads[i], load->location, drive, load->offset, load->address))
+		{
+			*error = "Unable to find a file to load, or its path is too long!";
+			return false;
+		}
+	}
+	return true;
+}
+
+//Fills in the bootloader arguments from the remembered selection. Fails if the
+//payload it resolved to is no longer there, so the configuration's other
+//locations get a chance.
+static bool use_selection(a9l_selection *selection, const a9l_memo_selection *remembered, const char *drive)
+{
+	if (!a9l_location_resolve(remembered->payload, drive, selection->payload, sizeof(selection->payload)) ||
+		!resolve_patch(remembered->patch, drive, selection->patch, sizeof(selection->patch)))
+		return false;
+
+	selection->offset = remembered->offset;
+	selection->num_loads = remembered->num_loads;
+	for (size_t i = 0; i < remembered->num_loads; ++i)
+	{
+		const a9l_memo_load *load = &remembered->loads[i];
+		if (!set_load_arguments(&selection->loads[i], load->location, drive, load->offset, load->address))
+			return false;
+	}
+	return true;
+}
+
+//Remembers the resolved locations, so a hit doesn't have to search for them
+static void remember_selection(a9l_memo *memo, uint32_t config, ctr_hid_button_type buttons, const a9l_selection *selection, const a9l_config_entry *entry)
+{
+	a9l_memo_selection remembered;
+	memset(&remembered, 0, sizeof(remembered));
+
+	remembered.config = config;
+	remembered.buttons = (uint32_t)buttons;
+	remembered.offset = (uint32_t)entry->offset;
+	remembered.num_loads = (uint32_t)entry->num_loads;
+
+	//Anything that doesn't fit is simply not remembered
+	bool fits = strlen(selection->payload) < sizeof(remembered.payload) &&
+		strlen(selection->patch) < sizeof(remembered.patch) &&
+		entry->num_loads <= A9L_MEMO_MAX_LOADS;
+	for (size_t i = 0; i < entry->num_loads && fits; ++i)
+	{
+		fits = strlen(selection->loads[i].location) < sizeof(remembered.loads[i].location);
+	}
+	if (!fits)
+		return;
+
+	strcpy(remembered.payload, selection->payload);
+	strcpy(remembered.patch, selection->patch);
+	for (size_t i = 0; i < entry->num_loads; ++i)
+	{
+		strcpy(remembered.loads[i].location, selection->loads[i].location);
+		remembered.loads[i].offset = (uint32_t)entry->loads[i].offset;
+		remembered.loads[i].address = entry->loads[i].address;
+	}
+	a9l_memo_set_selection(memo, &remembered);
+}
+
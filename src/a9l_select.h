@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_SELECT_H_
+#define A9L_SELECT_H_
+
+#include "a9l_config.h"
+#include "a9l_memo.h"
+
+#include <ctr9/ctr_hid.h>
+
+#include <stddef.h>
+#include <stdbool.h>
+
+//Additional loads are passed to the bootloader as text, like the payload
+typedef struct
+{
+	char location[256];
+	char offset[32];
+	char address[32];
+} a9l_select_load;
+
+//What the loader passes on to the bootloader, with every location resolved
+typedef struct
+{
+	char payload[256];
+	size_t offset;
+	char patch[256];
+	a9l_select_load loads[A9L_CONFIG_MAX_LOADS];
+	size_t num_loads;
+	//Whether the memo's selection was used instead of parsing the configuration
+	bool remembered;
+} a9l_selection;
+
+//Picks the entry for buttons from the configuration read from drive, config
+//being its NUL terminated contents, and resolves its files. Uses the memo's
+//selection if the configuration and buttons haven't changed, and remembers the
+//new one otherwise. On failure, error says what went wrong.
+bool a9l_select(a9l_selection *selection, a9l_memo *memo, const char *drive, const char *config, size_t config_size, ctr_hid_button_type buttons, const char **error);
+
+#endif//A9L_SELECT_H_
+
@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_timer.h"
+
+#define REG_TIMER_VAL(N) (*(volatile uint16_t*)(0x10003000u + (N)*4u))
+#define REG_TIMER_CNT(N) (*(volatile uint16_t*)(0x10003002u + (N)*4u))
+
+#define TIMER_PRESCALER_64 (1u)
+#define TIMER_COUNT_UP (1u << 2)
+#define TIMER_START (1u << 7)
+
+void a9l_timer_initialize(void)
+{
+	if (REG_TIMER_CNT(3) & TIMER_START)
+		return;
+
+	REG_TIMER_CNT(2) = 0;
+	REG_TIMER_CNT(3) = 0;
+	REG_TIMER_VAL(2) = 0;
+	REG_TIMER_VAL(3) = 0;
+
+	//Start the high half first so it doesn't miss the first overflow
+	REG_TIMER_CNT(3) = TIMER_START | TIMER_COUNT_UP;
+	REG_TIMER_CNT(2) = TIMER_START | TIMER_PRESCALER_64;
+}
+
+uint32_t a9l_timer_get_ticks(void)
+{
+	uint16_t high, low;
+	//Re-read if the low half overflowed in between reads
+	do
+	{
+		high = REG_TIMER_VAL(3);
+		low = REG_TIMER_VAL(2);
+	} while (high != REG_TIMER_VAL(3));
+
+	return ((uint32_t)high << 16) | low;
+}
+
@@ -0,0 +1,26 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_TIMER_H_
+#define A9L_TIMER_H_
+
+#include <stdint.h>
+
+//The ARM9 timers run off of the 67.027964 MHz bus clock. Timers 2 and 3 are
+//cascaded with a prescaler of 64, giving a 32 bit counter with roughly a
+//microsecond of resolution that wraps after a little over an hour.
+#define A9L_TIMER_FREQUENCY (67027964u/64u)
+
+//Starts the cascaded timers if they are not already running. Safe to call from
+//both the loader and the bootloader, the count is preserved across the jump.
+void a9l_timer_initialize(void);
+
+uint32_t a9l_timer_get_ticks(void);
+
+#endif//A9L_TIMER_H_
+
@@ -0,0 +1,279 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_trace.h"
+
+#ifdef A9L_TRACE
+
+#include "a9l_timer.h"
+
+#include <ctr9/io/ctr_drives.h>
+
+#include <string.h>
+#include <stdbool.h>
+
+#define ARRAY_SIZE(X) (sizeof(X)/sizeof(*X))
+
+#define TRACE_HEADER ((a9l_trace_header*)A9L_TRACE_ADDR)
+#define TRACE_PATHS ((char (*)[A9L_TRACE_PATH_SIZE])(A9L_TRACE_ADDR + sizeof(a9l_trace_header)))
+#define TRACE_RECORDS ((a9l_trace_record*)(A9L_TRACE_ADDR + sizeof(a9l_trace_header) + A9L_TRACE_MAX_PATHS * A9L_TRACE_PATH_SIZE))
+#define TRACE_MAX_RECORDS ((A9L_TRACE_SIZE - sizeof(a9l_trace_header) - A9L_TRACE_MAX_PATHS * A9L_TRACE_PATH_SIZE) / sizeof(a9l_trace_record))
+
+typedef struct
+{
+	FILE *file;
+	uint16_t path;
+} open_file;
+
+//Only valid within a single program, the bootloader does not inherit the
+//loader's open files.
+static open_file open_files[8];
+
+static uint16_t intern_path(const char *path);
+static uint16_t file_path(FILE *file);
+static uint32_t file_position(FILE *file);
+static void record(a9l_trace_operation operation, uint16_t path, uint32_t offset, uint32_t size, bool failed);
+
+void a9l_trace_initialize(void)
+{
+	a9l_timer_initialize();
+
+	a9l_trace_header *header = TRACE_HEADER;
+	header->magic = A9L_TRACE_MAGIC;
+	header->version = A9L_TRACE_VERSION;
+	header->num_paths = 0;
+	header->num_records = 0;
+	header->frequency = A9L_TIMER_FREQUENCY;
+}
+
+void a9l_trace_resume(void)
+{
+	const a9l_trace_header *header = TRACE_HEADER;
+	if (header->magic != A9L_TRACE_MAGIC ||
+		header->version != A9L_TRACE_VERSION ||
+		header->num_paths > A9L_TRACE_MAX_PATHS ||
+		header->num_records > TRACE_MAX_RECORDS)
+	{
+		a9l_trace_initialize();
+	}
+	else
+	{
+		a9l_timer_initialize();
+	}
+}
+
+int a9l_trace_write(void)
+{
+	const a9l_trace_header *header = TRACE_HEADER;
+	if (ctr_drives_check_ready("SD:"))
+		return -1;
+
+	//Writing the trace out is boot I/O too. It is recorded up front, since the
+	//trace can't change once it is being written.
+	uint16_t index = intern_path(A9L_TRACE_FILE);
+	record(A9L_TRACE_OPEN, index, 0, 0, false);
+	uint32_t size = (uint32_t)(sizeof(*header) + A9L_TRACE_PATH_SIZE * header->num_paths +
+		sizeof(a9l_trace_record) * (header->num_records + 2u));
+	record(A9L_TRACE_WRITE, index, 0, size, false);
+	record(A9L_TRACE_CLOSE, index, 0, 0, false);
+
+	FILE *file = fopen(A9L_TRACE_FILE, "wb");
+	if (!file)
+		return -1;
+
+	int res = 0;
+	res |= 1 != fwrite(header, sizeof(*header), 1, file);
+	if (header->num_paths)
+		res |= 1 != fwrite(TRACE_PATHS, A9L_TRACE_PATH_SIZE * header->num_paths, 1, file);
+	if (header->num_records)
+		res |= 1 != fwrite(TRACE_RECORDS, sizeof(a9l_trace_record) * header->num_records, 1, file);
+	res |= fclose(file);
+
+	return res ? -1 : 0;
+}
+
+FILE *a9l_trace_fopen(const char *path, const char *mode)
+{
+	uint16_t index = intern_path(path);
+	FILE *file = fopen(path, mode);
+	record(A9L_TRACE_OPEN, index, 0, 0, !file);
+
+	if (file)
+	{
+		for (size_t i = 0; i < ARRAY_SIZE(open_files); ++i)
+		{
+			if (!open_files[i].file)
+			{
+				open_files[i].file = file;
+				open_files[i].path = index;
+				break;
+			}
+		}
+	}
+	return file;
+}
+
+int a9l_trace_fclose(FILE *file)
+{
+	uint16_t index = file_path(file);
+	for (size_t i = 0; i < ARRAY_SIZE(open_files); ++i)
+	{
+		if (open_files[i].file == file)
+		{
+			open_files[i].file = NULL;
+			break;
+		}
+	}
+
+	int res = fclose(file);
+	record(A9L_TRACE_CLOSE, index, 0, 0, res != 0);
+	return res;
+}
+
+size_t a9l_trace_fread(void *buffer, size_t size, size_t count, FILE *file)
+{
+	uint32_t offset = file_position(file);
+	size_t res = fread(buffer, size, count, file);
+	record(A9L_TRACE_READ, file_path(file), offset, (uint32_t)(size * count), res != count);
+	return res;
+}
+
+size_t a9l_trace_fwrite(const void *buffer, size_t size, size_t count, FILE *file)
+{
+	uint32_t offset = file_position(file);
+	size_t res = fwrite(buffer, size, count, file);
+	record(A9L_TRACE_WRITE, file_path(file), offset, (uint32_t)(size * count), res != count);
+	return res;
+}
+
+int a9l_trace_fseek(FILE *file, long offset, int whence)
+{
+	uint32_t position = file_position(file);
+	int res = fseek(file, offset, whence);
+	record(A9L_TRACE_SEEK, file_path(file), position, file_position(file), res != 0);
+	return res;
+}
+
+int a9l_trace_stat(const char *path, struct stat *st)
+{
+	int res = stat(path, st);
+	record(A9L_TRACE_STAT, intern_path(path), 0, res ? 0 : (uint32_t)st->st_size, res != 0);
+	return res;
+}
+
+int a9l_trace_fstat(FILE *file, struct stat *st)
+{
+	int res = fstat(fileno(file), st);
+	record(A9L_TRACE_STAT, file_path(file), 0, res ? 0 : (uint32_t)st->st_size, res != 0);
+	return res;
+}
+
+int a9l_trace_chdrive(const char *drive)
+{
+	int res = ctr_drives_chdrive(drive);
+	record(A9L_TRACE_CHDRIVE, intern_path(drive), 0, 0, res != 0);
+	return res;
+}
+
+int a9l_trace_check_ready(const char *drive)
+{
+	int res = ctr_drives_check_ready(drive);
+	record(A9L_TRACE_READY, intern_path(drive), 0, 0, res != 0);
+	return res;
+}
+
+void a9l_trace_selection(bool hit)
+{
+	record(A9L_TRACE_SELECTION, A9L_TRACE_NO_PATH, 0, 0, !hit);
+}
+
+void a9l_trace_prefetch(bool hit)
+{
+	record(A9L_TRACE_PREFETCH, A9L_TRACE_NO_PATH, 0, 0, !hit);
+}
+
+//No background transfers on the console, see a9l_trace.h
+bool a9l_trace_fread_async(void *buffer, size_t size, FILE *file)
+{
+	(void)buffer;
+	(void)size;
+	(void)file;
+	return false;
+}
+
+bool a9l_trace_fwait(FILE *file)
+{
+	(void)file;
+	return true;
+}
+
+void a9l_trace_fcancel(FILE *file)
+{
+	(void)file;
+}
+
+//Helper functions follow
+
+static uint16_t intern_path(const char *path)
+{
+	a9l_trace_header *header = TRACE_HEADER;
+	char (*paths)[A9L_TRACE_PATH_SIZE] = TRACE_PATHS;
+
+	//Paths that don't fit aren't recorded, rather than being truncated into
+	//another file's path
+	size_t length = strlen(path);
+	if (length >= A9L_TRACE_PATH_SIZE)
+		return A9L_TRACE_NO_PATH;
+
+	for (uint16_t i = 0; i < header->num_paths; ++i)
+	{
+		if (strcmp(paths[i], path) == 0)
+			return i;
+	}
+
+	if (header->num_paths >= A9L_TRACE_MAX_PATHS)
+		return A9L_TRACE_NO_PATH;
+
+	memset(paths[header->num_paths], 0, A9L_TRACE_PATH_SIZE);
+	memcpy(paths[header->num_paths], path, length);
+	return header->num_paths++;
+}
+
+static uint16_t file_path(FILE *file)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(open_files); ++i)
+	{
+		if (open_files[i].file == file)
+			return open_files[i].path;
+	}
+	return A9L_TRACE_NO_PATH;
+}
+
+static uint32_t file_position(FILE *file)
+{
+	long position = ftell(file);
+	return position < 0 ? 0 : (uint32_t)position;
+}
+
+static void record(a9l_trace_operation operation, uint16_t path, uint32_t offset, uint32_t size, bool failed)
+{
+	a9l_trace_header *header = TRACE_HEADER;
+	if (header->num_records >= TRACE_MAX_RECORDS)
+		return;
+
+	a9l_trace_record *rec = &TRACE_RECORDS[header->num_records++];
+	rec->timestamp = a9l_timer_get_ticks();
+	rec->offset = offset;
+	rec->size = size;
+	rec->operation = (uint8_t)operation;
+	rec->failed = failed;
+	rec->path = path;
+}
+
+#endif//A9L_TRACE
+
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_TRACE_H_
+#define A9L_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+//Boot I/O trace. When built with --enable-trace, every file and drive access
+//made by the loader and bootloader is recorded into a buffer in memory that
+//survives the jump from the loader to the bootloader. The bootloader then
+//writes it out to A9L_TRACE_FILE right before jumping to the payload. The
+//tools/a9l_replay.c host program replays these traces.
+//
+//Trace file layout (all little endian):
+//  a9l_trace_header
+//  num_paths * A9L_TRACE_PATH_SIZE bytes of NUL padded paths
+//  num_records * a9l_trace_record
+
+#define A9L_TRACE_ADDR 0x27F00000u
+#define A9L_TRACE_SIZE 0x00040000u
+#define A9L_TRACE_FILE "SD:/arm9launcher.trace"
+
+#define A9L_TRACE_MAGIC 0x544C3941u //"A9LT"
+#define A9L_TRACE_VERSION 3u
+#define A9L_TRACE_MAX_PATHS 32u
+#define A9L_TRACE_PATH_SIZE 256u
+#define A9L_TRACE_NO_PATH 0xFFFFu
+
+typedef enum
+{
+	A9L_TRACE_OPEN = 0,
+	A9L_TRACE_CLOSE,
+	A9L_TRACE_READ,
+	A9L_TRACE_SEEK,
+	A9L_TRACE_STAT,
+	A9L_TRACE_CHDRIVE,
+	A9L_TRACE_READY,
+	A9L_TRACE_SELECTION,
+	A9L_TRACE_WRITE,
+	A9L_TRACE_PREFETCH
+} a9l_trace_operation;
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_paths;
+	uint32_t num_records;
+	uint32_t frequency;
+} a9l_trace_header;
+
+//offset is the file position before the operation took place, size is the
+//amount requested. For seeks, size holds the resulting position. Stats of open
+//files are recorded against the file's path. Selection
+//records mark whether the remembered selection was used (failed is set if it
+//wasn't), and prefetch records whether a prefetched payload was.
+typedef struct
+{
+	uint32_t timestamp;
+	uint32_t offset;
+	uint32_t size;
+	uint8_t operation;
+	uint8_t failed;
+	uint16_t path;
+} a9l_trace_record;
+
+#ifdef A9L_TRACE
+
+//Called by the loader, discards any previous trace.
+void a9l_trace_initialize(void);
+
+//Called by the bootloader, continues the trace started by the loader, or
+//starts a new one if there is none.
+void a9l_trace_resume(void);
+
+//Writes the trace out to A9L_TRACE_FILE. Returns 0 on success.
+int a9l_trace_write(void);
+
+FILE *a9l_trace_fopen(const char *path, const char *mode);
+int a9l_trace_fclose(FILE *file);
+size_t a9l_trace_fread(void *buffer, size_t size, size_t count, FILE *file);
+size_t a9l_trace_fwrite(const void *buffer, size_t size, size_t count, FILE *file);
+int a9l_trace_fseek(FILE *file, long offset, int whence);
+int a9l_trace_stat(const char *path, struct stat *st);
+int a9l_trace_fstat(FILE *file, struct stat *st);
+int a9l_trace_chdrive(const char *drive);
+int a9l_trace_check_ready(const char *drive);
+void a9l_trace_selection(bool hit);
+void a9l_trace_prefetch(bool hit);
+
+//Starts a read that goes on in the background, and returns false without
+//reading anything if the file's device can't do that. a9l_trace_fwait waits
+//for it and returns whether it read everything. a9l_trace_fcancel stops it,
+//leaving what it was reading into undefined. libctr9 only does blocking
+//transfers, so on the console nothing is ever read in the background.
+bool a9l_trace_fread_async(void *buffer, size_t size, FILE *file);
+bool a9l_trace_fwait(FILE *file);
+void a9l_trace_fcancel(FILE *file);
+
+#else
+
+#define a9l_trace_initialize() ((void)0)
+#define a9l_trace_resume() ((void)0)
+#define a9l_trace_write() (0)
+
+#define a9l_trace_fopen(path, mode) fopen(path, mode)
+#define a9l_trace_fclose(file) fclose(file)
+#define a9l_trace_fread(buffer, size, count, file) fread(buffer, size, count, file)
+#define a9l_trace_fwrite(buffer, size, count, file) fwrite(buffer, size, count, file)
+#define a9l_trace_fseek(file, offset, whence) fseek(file, offset, whence)
+#define a9l_trace_stat(path, st) stat(path, st)
+#define a9l_trace_fstat(file, st) fstat(fileno(file), st)
+#define a9l_trace_chdrive(drive) ctr_drives_chdrive(drive)
+#define a9l_trace_check_ready(drive) ctr_drives_check_ready(drive)
+#define a9l_trace_selection(hit) ((void)(hit))
+#define a9l_trace_prefetch(hit) ((void)(hit))
+#define a9l_trace_fread_async(buffer, size, file) ((void)(buffer), (void)(size), (void)(file), false)
+#define a9l_trace_fwait(file) ((void)(file), true)
+#define a9l_trace_fcancel(file) ((void)(file))
+
+#endif//A9L_TRACE
+
+#endif//A9L_TRACE_H_
+
@@ -0,0 +1,245 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "a9l_tune.h"
+#include "a9l_trace.h"
+#include "a9l_timer.h"
+
+#include <string.h>
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_drives;
+} tune_header;
+
+//Reading a whole window at once is a candidate too, so tuning does no worse
+//than barely splitting reads up at all
+static const size_t candidate_sizes[A9L_TUNE_NUM_SIZES] = {
+	32u * 1024u, 64u * 1024u, 128u * 1024u, 256u * 1024u, 512u * 1024u, A9L_TUNE_WINDOW
+};
+
+static const char *drive_names[A9L_TUNE_NUM_DRIVES] = { "SD:", "CTRNAND:", "TWLN:", "TWLP:" };
+
+static size_t find_drive(const char *path);
+static size_t next_candidate(const a9l_tune_drive *drive);
+static size_t partial_candidate(const a9l_tune_drive *drive);
+//Partial windows aren't samples, so on a drive that isn't settled they are read
+//at once, as they would be without tuning. A drive that only ever sees
+//payloads smaller than a window never settles, but isn't slowed down either.
+static size_t partial_candidate(const a9l_tune_drive *drive)
+{
+	return drive->settled ? drive->best : A9L_TUNE_NUM_SIZES - 1u;
+}
+
+static bool read_window(char *destination, size_t size, size_t chunk, FILE *file);
+static void record(a9l_tune *tune, size_t drive, size_t candidate, uint32_t ticks);
+static uint32_t throughput_of(uint64_t bytes, uint64_t ticks);
+static void retune(a9l_tune_drive *drive);
+
+void a9l_tune_initialize(a9l_tune *tune)
+{
+	memset(tune->drives, 0, sizeof(tune->drives));
+	memset(tune->boot_samples, 0, sizeof(tune->boot_samples));
+	memset(tune->boot_ticks, 0, sizeof(tune->boot_ticks));
+	tune->dirty = false;
+}
+
+bool a9l_tune_read(a9l_tune *tune, const char *path)
+{
+	a9l_tune_initialize(tune);
+
+	FILE *file = a9l_trace_fopen(path, "rb");
+	if (!file)
+		return false;
+
+	tune_header header;
+	bool res = 1 == a9l_trace_fread(&header, sizeof(header), 1, file) &&
+		header.magic == A9L_TUNE_MAGIC &&
+		header.version == A9L_TUNE_VERSION &&
+		header.num_drives == A9L_TUNE_NUM_DRIVES &&
+		1 == a9l_trace_fread(tune->drives, sizeof(tune->drives), 1, file);
+	a9l_trace_fclose(file);
+
+	for (size_t i = 0; i < A9L_TUNE_NUM_DRIVES && res; ++i)
+	{
+		res = tune->drives[i].best < A9L_TUNE_NUM_SIZES;
+	}
+
+	if (!res)
+		a9l_tune_initialize(tune);
+	return res;
+}
+
+bool a9l_tune_write(a9l_tune *tune, const char *path)
+{
+	if (!tune->dirty)
+		return true;
+
+	FILE *file = a9l_trace_fopen(path, "wb");
+	if (!file)
+		return false;
+
+	tune_header header = { A9L_TUNE_MAGIC, A9L_TUNE_VERSION, A9L_TUNE_NUM_DRIVES };
+	bool res = 1 == a9l_trace_fwrite(&header, sizeof(header), 1, file) &&
+		1 == a9l_trace_fwrite(tune->drives, sizeof(tune->drives), 1, file);
+	res = a9l_trace_fclose(file) == 0 && res;
+
+	tune->dirty = !res;
+	return res;
+}
+
+bool a9l_tune_fread(a9l_tune *tune, const char *path, void *buffer, size_t size, FILE *file)
+{
+	size_t drive = find_drive(path);
+	if (drive == A9L_TUNE_NUM_DRIVES)
+		return 1 == a9l_trace_fread(buffer, size, 1, file);
+
+	char *destination = buffer;
+	for (size_t done = 0; done < size;)
+	{
+		size_t window = size - done < A9L_TUNE_WINDOW ? size - done : A9L_TUNE_WINDOW;
+		size_t candidate = window == A9L_TUNE_WINDOW ?
+			next_candidate(&tune->drives[drive]) : partial_candidate(&tune->drives[drive]);
+
+		uint32_t start = a9l_timer_get_ticks();
+		if (!read_window(destination + done, window, candidate_sizes[candidate], file))
+			return false;
+
+		//A partial window isn't comparable with the other samples
+		if (window == A9L_TUNE_WINDOW)
+			record(tune, drive, candidate, a9l_timer_get_ticks() - start);
+		done += window;
+	}
+	return true;
+}
+
+void a9l_tune_finish(a9l_tune *tune)
+{
+	for (size_t i = 0; i < A9L_TUNE_NUM_DRIVES; ++i)
+	{
+		a9l_tune_drive *state = &tune->drives[i];
+		uint32_t samples = tune->boot_samples[i];
+		uint64_t ticks = tune->boot_ticks[i];
+		tune->boot_samples[i] = 0;
+		tune->boot_ticks[i] = 0;
+
+		//A boot that didn't read a whole window says nothing either way
+		if (!state->settled || !samples || !ticks)
+			continue;
+
+		//Off by more than a quarter either way. Faster counts too, as another size
+		//may now be faster still.
+		uint32_t throughput = throughput_of((uint64_t)samples * A9L_TUNE_WINDOW, ticks);
+		uint32_t expected = state->throughput[state->best];
+		bool drifted = throughput < expected - expected / 4u || throughput > expected + expected / 4u;
+		if (drifted)
+		{
+			state->drift++;
+			if (state->drift >= A9L_TUNE_DRIFT_LIMIT)
+				retune(state);
+			tune->dirty = true;
+		}
+		else if (state->drift)
+		{
+			state->drift = 0;
+			tune->dirty = true;
+		}
+	}
+}
+
+//Helper functions follow
+
+static size_t find_drive(const char *path)
+{
+	for (size_t i = 0; i < A9L_TUNE_NUM_DRIVES; ++i)
+	{
+		if (strncmp(path, drive_names[i], strlen(drive_names[i])) == 0)
+			return i;
+	}
+	return A9L_TUNE_NUM_DRIVES;
+}
+
+static size_t next_candidate(const a9l_tune_drive *drive)
+{
+	if (drive->settled)
+		return drive->best;
+
+	size_t candidate = 0;
+	for (size_t i = 1; i < A9L_TUNE_NUM_SIZES; ++i)
+	{
+		if (drive->samples[i] < drive->samples[candidate])
+			candidate = i;
+	}
+	return candidate;
+}
+
+static bool read_window(char *destination, size_t size, size_t chunk, FILE *file)
+{
+	for (size_t done = 0; done < size;)
+	{
+		size_t amount = size - done < chunk ? size - done : chunk;
+		if (1 != a9l_trace_fread(destination + done, amount, 1, file))
+			return false;
+		done += amount;
+	}
+	return true;
+}
+
+//Settled drives only gather the boot's samples, a9l_tune_finish checks them
+static void record(a9l_tune *tune, size_t drive, size_t candidate, uint32_t ticks)
+{
+	if (!ticks)
+		return;
+
+	a9l_tune_drive *state = &tune->drives[drive];
+	if (state->settled)
+	{
+		tune->boot_samples[drive]++;
+		tune->boot_ticks[drive] += ticks;
+		return;
+	}
+
+	//Running mean of the candidate's samples
+	uint32_t throughput = throughput_of(A9L_TUNE_WINDOW, ticks);
+	uint64_t count = state->samples[candidate];
+	state->throughput[candidate] = (uint32_t)(((uint64_t)state->throughput[candidate] * count + throughput) / (count + 1u));
+	if (state->samples[candidate] < UINT8_MAX)
+		state->samples[candidate]++;
+	tune->dirty = true;
+
+	for (size_t i = 0; i < A9L_TUNE_NUM_SIZES; ++i)
+	{
+		if (state->samples[i] < A9L_TUNE_SAMPLES)
+			return;
+	}
+
+	uint8_t best = 0;
+	for (uint8_t i = 1; i < A9L_TUNE_NUM_SIZES; ++i)
+	{
+		if (state->throughput[i] > state->throughput[best])
+			best = i;
+	}
+	state->best = best;
+	state->settled = 1;
+	state->drift = 0;
+}
+
+//Bytes per second
+static uint32_t throughput_of(uint64_t bytes, uint64_t ticks)
+{
+	uint64_t rate = bytes * A9L_TIMER_FREQUENCY / ticks;
+	return rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+}
+
+static void retune(a9l_tune_drive *drive)
+{
+	memset(drive, 0, sizeof(*drive));
+}
+
@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_TUNE_H_
+#define A9L_TUNE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+//Read size tuning. Each drive responds differently to the size of the
+//requests made to it, so payload reads are split into chunks of a size picked
+//per drive. Reads are made in windows of A9L_TUNE_WINDOW bytes, and every whole
+//window is a sample: it is read with one candidate chunk size and timed. As
+//samples all cover the same number of bytes, payloads of any size can be mixed
+//without favoring one candidate. Until a drive is settled, each window uses
+//the candidate with the fewest samples, and partial windows are read at once.
+//Once every candidate has enough samples, the fastest one is used from then
+//on. If the chosen size's
+//throughput over a boot drifts away from what was recorded on consecutive
+//boots, the drive is tuned again.
+//
+//The state is kept in A9L_TUNE_FILE. It only changes, and is only written,
+//while a drive is being tuned or when drift is detected.
+
+#define A9L_TUNE_FILE "SD:/arm9launcher.tun"
+#define A9L_TUNE_MAGIC 0x524C3941u //"A9LR"
+#define A9L_TUNE_VERSION 2u
+
+#define A9L_TUNE_NUM_DRIVES 4u
+#define A9L_TUNE_NUM_SIZES 6u
+
+//Samples needed per candidate size before a drive is settled
+#define A9L_TUNE_SAMPLES 2u
+
+//Bytes per sample, and the largest candidate. Big enough that splitting larger
+//reads into windows adds next to nothing.
+#define A9L_TUNE_WINDOW (1024u * 1024u)
+
+//Consecutive boots the chosen size must be off by more than a quarter of its
+//recorded throughput, over all of the boot's samples, before a drive is tuned
+//again
+#define A9L_TUNE_DRIFT_LIMIT 2u
+
+typedef struct
+{
+	//Bytes per second for each candidate size
+	uint32_t throughput[A9L_TUNE_NUM_SIZES];
+	uint8_t samples[A9L_TUNE_NUM_SIZES];
+	uint8_t best;
+	uint8_t settled;
+	uint8_t drift;
+	uint8_t reserved[3];
+} a9l_tune_drive;
+
+typedef struct
+{
+	a9l_tune_drive drives[A9L_TUNE_NUM_DRIVES];
+	//This boot's samples of each settled drive's chosen size, not saved
+	uint32_t boot_samples[A9L_TUNE_NUM_DRIVES];
+	uint64_t boot_ticks[A9L_TUNE_NUM_DRIVES];
+	bool dirty;
+} a9l_tune;
+
+void a9l_tune_initialize(a9l_tune *tune);
+
+//Returns false, leaving every drive untuned, if the file is missing or invalid
+bool a9l_tune_read(a9l_tune *tune, const char *path);
+
+//Only touches the file if something changed since it was read
+bool a9l_tune_write(a9l_tune *tune, const char *path);
+
+//Reads size bytes from file, which was opened from path, into buffer in chunks
+//of the size tuned for path's drive, and learns from how long it took. Returns
+//true if everything was read.
+bool a9l_tune_fread(a9l_tune *tune, const char *path, void *buffer, size_t size, FILE *file);
+
+//Checks settled drives for drift against this boot's samples. Call once at
+//the end of the boot, before a9l_tune_write.
+void a9l_tune_finish(a9l_tune *tune);
+
+#endif//A9L_TUNE_H_
+
@@ -7,90 +7,149 @@
  ******************************************************************************/
 
 #include <elf.h>
+#include "a9l_trace.h"
+#include "load_list.h"
+#include "a9l_resident.h"
+#include "a9l_tune.h"
+#include "a9l_timer.h"
+#include "a9l_mem.h"
 
 #include <ctrelf.h>
 
 #include <ctr9/io.h>
 #include <ctr9/ctr_system.h>
 #include <ctr9/io/ctr_drives.h>
-#include <ctr9/ctr_cache.h>
 #include <ctr9/sha.h>
 
 #include <stdlib.h>
-#include <limits.h>
 #include <sys/stat.h>
 
 #define PAYLOAD_ADDRESS (0x23F00000)
 #define PAYLOAD_POINTER ((void*)PAYLOAD_ADDRESS)
 #define PAYLOAD_FUNCTION ((void (*)(void))PAYLOAD_ADDRESS)
 
-inline static void vol_memcpy(volatile void *dest, volatile void *sorc, size_t size)
+static void close_sources(FILE *file, FILE *source)
 {
-	volatile uint8_t *dst = dest;
-	volatile uint8_t *src = sorc;
-	while(size--)
-		dst[size] = src[size];
-}
-
-static int set_position(FILE *file, uint64_t position)
-{
-	if (fseek(file, 0, SEEK_SET)) return -1;
-	while (position > LONG_MAX)
-	{
-		long pos = LONG_MAX;
-		if (fseek(file, pos, SEEK_CUR)) return -1;
-		position -= LONG_MAX;
-	}
-
-	if (fseek(file, position, SEEK_CUR)) return -1;
-	return 0;
+	if (source != file)
+		fclose(source);
+	a9l_trace_fclose(file);
 }
 
 void ctr_libctr9_init(void);
 
+//Arguments from the loader: payload path, payload offset, OTP hash, IPS patch
+//path (empty if none), followed by a (path, offset, address) triple for every
+//additional load.
+#define BASE_ARGUMENTS 4
+#define LOAD_ARGUMENTS 3
+
 int main(int argc, char *argv[])
 {
 	ctr_libctr9_init();
-	if (argc == 3)
+	a9l_trace_resume();
+	if (argc >= BASE_ARGUMENTS && (argc - BASE_ARGUMENTS) % LOAD_ARGUMENTS == 0)
 	{
 		//Initialize all possible default IO systems
-		FILE *fil = fopen(argv[0], "rb");
+		FILE *fil = a9l_trace_fopen(argv[0], "rb");
 		if (!fil)
 		{
 			return -1;
 		}
 
+		//Where the payload's headers are read from, either the file itself or
+		//its copy in the resident cache
+		FILE *source = fil;
+#ifdef A9L_RESIDENT_CACHE
+		a9l_resident cache;
+		a9l_resident_initialize(&cache, (void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE);
+		size_t image_size = 0;
+		void *image = a9l_resident_load(&cache, argv[0], fil, &image_size);
+		FILE *memory = image ? fmemopen(image, image_size, "rb") : NULL;
+		if (memory)
+			source = memory;
+#endif
+
 		Elf32_Ehdr header;
-		load_header(&header, fil);
-		fseek(fil, 0, SEEK_SET);
+		load_header(&header, source);
 
 		//Restore otp hash
-		vol_memcpy(REG_SHAHASH, argv[2], 32);
+		a9l_mem_copy_volatile(REG_SHAHASH, argv[2], 32);
+
+		load_list list;
+		load_list_initialize(&list);
+		void (*entry)(int, const char *[]);
 
 		if (check_elf(&header)) //ELF
 		{
-			load_segments(&header, fil);
-			((void (*)(int, const char *[]))(header.e_entry))(0, NULL);
+			if (queue_segments(&header, source, argv[0], &list))
+			{
+				close_sources(fil, source);
+				return -2;
+			}
+			entry = (void (*)(int, const char *[]))(header.e_entry);
 		}
 		else
 		{
 			//Read payload, then jump to it
 			size_t offset = (size_t)strtol(argv[1], NULL, 0);
-			struct stat st;
-			fstat(fileno(fil), &st);
-			size_t payload_size = ((size_t)st.st_size) - offset; //FIXME Should we limit the size???
+			size_t size = LOAD_TO_END; //FIXME Should we limit the size???
+#ifdef A9L_RESIDENT_CACHE
+			if (memory && offset <= image_size)
+				size = image_size - offset;
+#endif
+			load_list_add(&list, argv[0], offset, PAYLOAD_POINTER, size, 0);
+			entry = (void (*)(int, const char *[]))PAYLOAD_ADDRESS;
+		}
 
-			set_position(fil, offset);
+		for (int i = BASE_ARGUMENTS; i < argc; i += LOAD_ARGUMENTS)
+		{
+			uint64_t offset = strtoull(argv[i+1], NULL, 0);
+			void *address = (void*)strtoul(argv[i+2], NULL, 0);
+			if (load_list_add(&list, argv[i], offset, address, LOAD_TO_END, 0))
+			{
+				close_sources(fil, source);
+				return -3;
+			}
+		}
+
+#ifdef A9L_RESIDENT_CACHE
+		if (memory)
+		{
+			//Copying the payload over its own cached copy would corrupt it
+			if (load_list_overlaps(&list, argv[0], (void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE))
+				a9l_resident_invalidate(&cache);
+			else
+				load_list_set_image(&list, argv[0], image, image_size);
+			fclose(memory);
+		}
+#endif
+		load_list_adopt_file(&list, argv[0], fil);
 
-			fread(PAYLOAD_POINTER, payload_size, 1, fil);
-			fclose(fil);
+#ifdef A9L_READ_TUNING
+		a9l_tune tune;
+		a9l_timer_initialize();
+		a9l_tune_read(&tune, A9L_TUNE_FILE);
+		load_list_set_tuning(&list, &tune);
+#endif
 
-			ctr_cache_clean_data_range(PAYLOAD_POINTER, (void*)(PAYLOAD_ADDRESS + payload_size));
-			ctr_cache_flush_instruction_range(PAYLOAD_POINTER, (void*)(PAYLOAD_ADDRESS + payload_size));
-			ctr_cache_drain_write_buffer();
+		if (argv[3][0])
+		{
+			load_list_set_patch(&list, argv[0], argv[3]);
+		}
 
-			((void (*)(int, const char *[]))PAYLOAD_ADDRESS)(0, NULL);
+		//Loads everything, and cleans/flushes caches once at the end
+		if (load_list_run(&list))
+		{
+			return -4;
 		}
+
+#ifdef A9L_READ_TUNING
+		a9l_tune_finish(&tune);
+		a9l_tune_write(&tune, A9L_TUNE_FILE);
+#endif
+
+		(void)a9l_trace_write();
+		entry(0, NULL);
 	}
 	return 0;
 }
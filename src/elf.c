@@ -1,34 +1,19 @@
 #include <ctr9/io.h>
-#include <ctr9/ctr_cache.h>
 #include <elf.h>
-#include <string.h>
+#include "a9l_trace.h"
 #include <stdio.h>
-#include <limits.h>
 
 void load_header(Elf32_Ehdr *header, FILE *file)
 {
-	fseek(file, 0, SEEK_SET);
-	char buffer[sizeof(*header)];
-	fread(buffer, sizeof(buffer), 1, file);
+	a9l_trace_fseek(file, 0, SEEK_SET);
+	//A short file leaves the rest zeroed, so check_elf rejects it
+	char buffer[sizeof(*header)] = { 0 };
+	a9l_trace_fread(buffer, sizeof(buffer), 1, file);
 
 	elf_load_header(header, buffer);
 }
 
-static int set_position(FILE *file, uint64_t position)
-{
-	if (fseek(file, 0, SEEK_SET)) return -1;
-	while (position > LONG_MAX)
-	{
-		long pos = LONG_MAX;
-		if (fseek(file, pos, SEEK_CUR)) return -1;
-		position -= LONG_MAX;
-	}
-
-	if (fseek(file, position, SEEK_CUR)) return -1;
-	return 0;
-}
-
-int load_segment(const Elf32_Phdr *header, FILE *file)
+int queue_segment(const Elf32_Phdr *header, const char *path, load_list *list)
 {
 	size_t program_size = header->p_filesz;
 	size_t mem_size = header->p_memsz;
@@ -41,28 +26,27 @@ int load_segment(const Elf32_Phdr *header, FILE *file)
 		case PT_LOAD:
 			break;
 		default:
-			return 1;
+			return 0;
 	}
 
-	set_position(file, header->p_offset);
-	fread(location, program_size, 1, file);
-	memset(program_size + (char*)location, 0, mem_size - program_size);
+	if (program_size > mem_size)
+		return 1;
 
-	ctr_cache_clean_data_range(location, (char*)location + mem_size);
-	ctr_cache_flush_instruction_range(location, (char*)location + mem_size);
-	ctr_cache_drain_write_buffer();
-
-	return 0;
+	return load_list_add(list, path, header->p_offset, location, program_size, mem_size - program_size);
 }
 
-int load_segments(const Elf32_Ehdr *header, FILE *file)
+int queue_segments(const Elf32_Ehdr *header, FILE *file, const char *path, load_list *list)
 {
 	int res = 0;
 	size_t pnum = header->e_phnum;
-	char buffer[pnum][header->e_phentsize];
+	char buffer[ELF_MAX_PROGRAM_HEADERS][ELF_PROGRAM_HEADER_SIZE];
+
+	if (pnum > ELF_MAX_PROGRAM_HEADERS || header->e_phentsize != ELF_PROGRAM_HEADER_SIZE)
+		return 1;
 
-	set_position(file, header->e_phoff);
-	res = 1 != fread(buffer, sizeof(buffer), 1, file);
+	if (load_list_set_position(file, header->e_phoff))
+		return 1;
+	res = pnum != a9l_trace_fread(buffer, ELF_PROGRAM_HEADER_SIZE, pnum, file);
 
 	if (res)
 		return res;
@@ -71,7 +55,7 @@ int load_segments(const Elf32_Ehdr *header, FILE *file)
 	{
 		Elf32_Phdr pheader;
 		elf_load_program_header(&pheader, buffer[i]);
-		res = load_segment(&pheader, file);
+		res = queue_segment(&pheader, path, list);
 		if (res)
 			return res;
 	}
@@ -2,11 +2,20 @@
 #define ELF_H_
 
 #include <ctr9/io.h>
+#include "load_list.h"
+
 #include <ctrelf.h>
 #include <stdio.h>
 
+//Program header tables come straight from the payload file, so bound them
+//before reading them onto the stack.
+#define ELF_MAX_PROGRAM_HEADERS 32u
+#define ELF_PROGRAM_HEADER_SIZE 32u
+
 void load_header(Elf32_Ehdr *header, FILE *file);
-int load_segment(const Elf32_Phdr *header, FILE *file);
-int load_segments(const Elf32_Ehdr *header, FILE *file);
+
+//Queue PT_LOAD segments into the load list. Other segment types are skipped.
+int queue_segment(const Elf32_Phdr *header, const char *path, load_list *list);
+int queue_segments(const Elf32_Ehdr *header, FILE *file, const char *path, load_list *list);
 bool check_elf(Elf32_Ehdr *header);
 #endif//ELF_H_
@@ -0,0 +1,144 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "ips.h"
+#include "a9l_trace.h"
+#include "a9l_mem.h"
+
+#include <string.h>
+
+#define IPS_HEADER "PATCH"
+#define IPS_FOOTER 0x454F46u //"EOF"
+
+static int read_be(FILE *file, size_t bytes, uint32_t *value);
+static ips_region *find_region(ips_region regions[], size_t count, uint64_t position, uint64_t *next);
+static int apply_record(FILE *file, ips_region regions[], size_t count, uint64_t offset, size_t size, int fill);
+
+int ips_apply(FILE *file, ips_region regions[], size_t count)
+{
+	char header[sizeof(IPS_HEADER) - 1];
+	if (1 != a9l_trace_fread(header, sizeof(header), 1, file) ||
+		memcmp(header, IPS_HEADER, sizeof(header)) != 0)
+		return -1;
+
+	for (;;)
+	{
+		uint32_t offset, size;
+		if (read_be(file, 3, &offset))
+			return -1;
+
+		if (offset == IPS_FOOTER)
+			return 0;
+
+		if (read_be(file, 2, &size))
+			return -1;
+
+		int res;
+		if (size)
+		{
+			res = apply_record(file, regions, count, offset, size, -1);
+		}
+		else
+		{
+			//Run length encoded record
+			uint32_t value;
+			if (read_be(file, 2, &size) || read_be(file, 1, &value))
+				return -1;
+			res = apply_record(file, regions, count, offset, size, (int)value);
+		}
+
+		if (res)
+			return res;
+	}
+}
+
+//Helper functions follow
+
+static int read_be(FILE *file, size_t bytes, uint32_t *value)
+{
+	uint8_t buffer[4];
+	if (1 != a9l_trace_fread(buffer, bytes, 1, file))
+		return -1;
+
+	*value = 0;
+	for (size_t i = 0; i < bytes; ++i)
+		*value = (*value << 8) | buffer[i];
+	return 0;
+}
+
+//Finds the region holding position. If there is none, next is set to the start
+//of the closest region after position, or UINT64_MAX.
+static ips_region *find_region(ips_region regions[], size_t count, uint64_t position, uint64_t *next)
+{
+	*next = UINT64_MAX;
+	for (size_t i = 0; i < count; ++i)
+	{
+		ips_region *region = &regions[i];
+		if (position >= region->offset &&
+			(region->extendable || position < region->offset + region->size))
+			return region;
+
+		if (region->offset > position && region->offset < *next)
+			*next = region->offset;
+	}
+	return NULL;
+}
+
+//fill is the byte to repeat for run length encoded records, or -1 to read the
+//data from the patch
+static int apply_record(FILE *file, ips_region regions[], size_t count, uint64_t offset, size_t size, int fill)
+{
+	while (size)
+	{
+		uint64_t next;
+		ips_region *region = find_region(regions, count, offset, &next);
+		size_t amount;
+		if (region)
+		{
+			uint64_t region_left = region->offset + region->size - offset;
+			amount = region->extendable || region_left > size ? size : (size_t)region_left;
+
+			//Whatever is past the limit isn't part of this region
+			if (region->extendable && offset + amount - region->offset > region->limit)
+				return -1;
+
+			//Writing past the end of the file, anything skipped over is zero
+			if (offset > region->offset + region->size)
+			{
+				a9l_mem_zero(region->destination + region->size, (size_t)(offset - region->offset) - region->size);
+				region->size = (size_t)(offset - region->offset);
+			}
+
+			char *destination = region->destination + (offset - region->offset);
+			if (fill < 0)
+			{
+				if (1 != a9l_trace_fread(destination, amount, 1, file))
+					return -1;
+			}
+			else
+			{
+				a9l_mem_fill(destination, fill, amount);
+			}
+
+			if (offset + amount > region->offset + region->size)
+				region->size = (size_t)(offset + amount - region->offset);
+		}
+		else
+		{
+			//Not loaded, skip over it
+			amount = next - offset > size ? size : (size_t)(next - offset);
+			if (fill < 0 && a9l_trace_fseek(file, (long)amount, SEEK_CUR))
+				return -1;
+		}
+
+		offset += amount;
+		size -= amount;
+	}
+	return 0;
+}
+
@@ -0,0 +1,36 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef IPS_H_
+#define IPS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+//A range of the patched file that has been placed in memory. Patch data is
+//written straight into destination, so no copy of the whole file is needed.
+//An extendable region is the tail of the file, and may grow up to limit bytes
+//if the patch writes past the end of the file.
+typedef struct
+{
+	uint64_t offset;
+	char *destination;
+	size_t size;
+	size_t limit;
+	bool extendable;
+} ips_region;
+
+//Applies the IPS patch read from file to the given regions. Patch data for
+//parts of the file not in any region is skipped, but a patch that would grow
+//a region past its limit fails. Returns 0 on success.
+int ips_apply(FILE *file, ips_region regions[], size_t count);
+
+#endif//IPS_H_
+
@@ -0,0 +1,401 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#include "load_list.h"
+#include "a9l_trace.h"
+#include "ips.h"
+#include "a9l_mem.h"
+
+#include <ctr9/io.h>
+#include <ctr9/ctr_cache.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+//What a load actually placed in memory
+typedef struct
+{
+	size_t size;
+	bool at_end;
+} load_result;
+
+static size_t drive_length(const char *path);
+static int compare_items(const void *a, const void *b);
+static bool file_size(const load_list *list, const char *path, uint64_t *size);
+static bool find_overlap(const load_list *list);
+static int load_item_from(const load_item *item, FILE *file, a9l_tune *tune, load_result *result);
+static int load_item_from_image(const load_item *item, const void *image, size_t image_size, load_result *result);
+static size_t room_after(const load_list *list, size_t index);
+static int apply_patch(const load_list *list, load_result results[]);
+
+void load_list_initialize(load_list *list)
+{
+	list->count = 0;
+	list->open_path = NULL;
+	list->open_file = NULL;
+	list->image_path = NULL;
+	list->image = NULL;
+	list->image_size = 0;
+	list->patch_target = NULL;
+	list->patch_path = NULL;
+	list->tune = NULL;
+}
+
+void load_list_set_patch(load_list *list, const char *target, const char *patch)
+{
+	list->patch_target = target;
+	list->patch_path = patch;
+}
+
+void load_list_set_tuning(load_list *list, a9l_tune *tune)
+{
+	list->tune = tune;
+}
+
+void load_list_adopt_file(load_list *list, const char *path, FILE *file)
+{
+	list->open_path = path;
+	list->open_file = file;
+}
+
+void load_list_set_image(load_list *list, const char *path, const void *image, size_t image_size)
+{
+	list->image_path = path;
+	list->image = image;
+	list->image_size = image_size;
+}
+
+bool load_list_overlaps(const load_list *list, const char *path, const void *start, size_t size)
+{
+	uintptr_t begin = (uintptr_t)start;
+	uintptr_t end = begin + size;
+	for (size_t i = 0; i < list->count; ++i)
+	{
+		const load_item *item = &list->items[i];
+		if (strcmp(item->path, path) != 0)
+			continue;
+
+		uintptr_t item_begin = (uintptr_t)item->destination;
+		//Sizes to the end of the file aren't known yet, assume the worst
+		uintptr_t item_end = item->size == LOAD_TO_END ? UINTPTR_MAX :
+			item_begin + item->size + item->zero_size;
+		if (item_begin < end && item_end > begin)
+			return true;
+	}
+	return false;
+}
+
+int load_list_set_position(FILE *file, uint64_t position)
+{
+	if (a9l_trace_fseek(file, 0, SEEK_SET)) return -1;
+	while (position > LONG_MAX)
+	{
+		long pos = LONG_MAX;
+		if (a9l_trace_fseek(file, pos, SEEK_CUR)) return -1;
+		position -= LONG_MAX;
+	}
+
+	if (a9l_trace_fseek(file, (long)position, SEEK_CUR)) return -1;
+	return 0;
+}
+
+int load_list_add(load_list *list, const char *path, uint64_t offset, void *destination, size_t size, size_t zero_size)
+{
+	if (list->count >= LOAD_LIST_MAX_ITEMS)
+		return -1;
+
+	load_item *item = &list->items[list->count++];
+	item->path = path;
+	item->offset = offset;
+	item->destination = destination;
+	item->size = size;
+	item->zero_size = zero_size;
+	return 0;
+}
+
+int load_list_run(load_list *list)
+{
+	qsort(list->items, list->count, sizeof(load_item), compare_items);
+
+	load_result results[LOAD_LIST_MAX_ITEMS] = { { 0 } };
+	FILE *file = NULL;
+	const char *current_path = NULL;
+
+	//Loads aren't done in the order they were queued, so which of two
+	//overlapping loads wins would come down to their paths. Refuse them.
+	int res = find_overlap(list) ? -1 : 0;
+
+	//Loads served from memory go first, before anything can overwrite the image
+	for (size_t i = 0; i < list->count && !res && list->image; ++i)
+	{
+		const load_item *item = &list->items[i];
+		if (strcmp(list->image_path, item->path) == 0)
+			res = load_item_from_image(item, list->image, list->image_size, &results[i]);
+	}
+
+	for (size_t i = 0; i < list->count && !res; ++i)
+	{
+		const load_item *item = &list->items[i];
+		if (list->image && strcmp(list->image_path, item->path) == 0)
+			continue;
+
+		if (!current_path || strcmp(current_path, item->path) != 0)
+		{
+			if (file)
+				a9l_trace_fclose(file);
+
+			current_path = item->path;
+			if (list->open_file && strcmp(list->open_path, item->path) == 0)
+			{
+				file = list->open_file;
+				list->open_file = NULL;
+			}
+			else
+			{
+				file = a9l_trace_fopen(item->path, "rb");
+			}
+			if (!file)
+			{
+				res = -1;
+				break;
+			}
+		}
+
+		res = load_item_from(item, file, list->tune, &results[i]);
+	}
+
+	if (file)
+		a9l_trace_fclose(file);
+
+	if (list->open_file)
+	{
+		a9l_trace_fclose(list->open_file);
+		list->open_file = NULL;
+	}
+
+	if (res)
+		return res;
+
+	//Patch in place, now that the whole target is in memory
+	if (list->patch_path)
+	{
+		res = apply_patch(list, results);
+		if (res)
+			return res;
+	}
+
+	//Single cache maintenance pass over everything that was written
+	for (size_t i = 0; i < list->count; ++i)
+	{
+		char *start = list->items[i].destination;
+		ctr_cache_clean_data_range(start, start + results[i].size + list->items[i].zero_size);
+	}
+
+	for (size_t i = 0; i < list->count; ++i)
+	{
+		char *start = list->items[i].destination;
+		ctr_cache_flush_instruction_range(start, start + results[i].size + list->items[i].zero_size);
+	}
+	ctr_cache_drain_write_buffer();
+
+	return 0;
+}
+
+//Helper functions follow
+
+static size_t drive_length(const char *path)
+{
+	const char *colon = strchr(path, ':');
+	return colon ? (size_t)(colon - path) : 0;
+}
+
+static int compare_items(const void *a, const void *b)
+{
+	const load_item *left = a;
+	const load_item *right = b;
+
+	//Group by drive first, then by file, then by position in the file
+	size_t left_drive = drive_length(left->path);
+	size_t right_drive = drive_length(right->path);
+	int res = strncmp(left->path, right->path, left_drive < right_drive ? left_drive : right_drive);
+	if (res)
+		return res;
+	if (left_drive != right_drive)
+		return left_drive < right_drive ? -1 : 1;
+
+	res = strcmp(left->path, right->path);
+	if (res)
+		return res;
+
+	if (left->offset != right->offset)
+		return left->offset < right->offset ? -1 : 1;
+	return 0;
+}
+
+static bool file_size(const load_list *list, const char *path, uint64_t *size)
+{
+	if (list->image && strcmp(list->image_path, path) == 0)
+	{
+		*size = list->image_size;
+		return true;
+	}
+
+	struct stat st;
+	int res = list->open_file && strcmp(list->open_path, path) == 0 ?
+		a9l_trace_fstat(list->open_file, &st) : a9l_trace_stat(path, &st);
+	if (res)
+		return false;
+
+	*size = (uint64_t)st.st_size;
+	return true;
+}
+
+//Items must already be sorted, so each file is only looked up once. A file
+//that can't be looked up counts as an overlap, it couldn't be loaded anyway.
+static bool find_overlap(const load_list *list)
+{
+	uintptr_t begin[LOAD_LIST_MAX_ITEMS];
+	uintptr_t end[LOAD_LIST_MAX_ITEMS];
+	const char *path = NULL;
+	uint64_t size = 0;
+
+	for (size_t i = 0; i < list->count; ++i)
+	{
+		const load_item *item = &list->items[i];
+		uint64_t item_size = item->size;
+		if (item->size == LOAD_TO_END)
+		{
+			if (!path || strcmp(path, item->path) != 0)
+			{
+				path = item->path;
+				if (!file_size(list, path, &size))
+					return true;
+			}
+			if (size < item->offset)
+				return true;
+			item_size = size - item->offset;
+		}
+
+		begin[i] = (uintptr_t)item->destination;
+		end[i] = begin[i] + (uintptr_t)item_size + item->zero_size;
+		if (end[i] < begin[i])
+			return true;
+
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (begin[j] < end[i] && begin[i] < end[j])
+				return true;
+		}
+	}
+	return false;
+}
+
+static int load_item_from_image(const load_item *item, const void *image, size_t image_size, load_result *result)
+{
+	if (item->offset > image_size)
+		return -1;
+
+	size_t size = item->size;
+	if (size == LOAD_TO_END)
+		size = image_size - (size_t)item->offset;
+	else if (size > image_size - (size_t)item->offset)
+		return -1;
+
+	a9l_mem_copy(item->destination, (const char*)image + item->offset, size);
+	a9l_mem_zero((char*)item->destination + size, item->zero_size);
+	result->size = size;
+	result->at_end = item->offset + size == image_size;
+	return 0;
+}
+
+static int load_item_from(const load_item *item, FILE *file, a9l_tune *tune, load_result *result)
+{
+	size_t size = item->size;
+	if (size == LOAD_TO_END)
+	{
+		struct stat st;
+		if (a9l_trace_fstat(file, &st) || (uint64_t)st.st_size < item->offset)
+			return -1;
+		size = (size_t)((uint64_t)st.st_size - item->offset);
+	}
+
+	//Items are sorted by offset, so skip the seek if already there
+	long position = ftell(file);
+	if (position < 0 || (uint64_t)position != item->offset)
+	{
+		if (load_list_set_position(file, item->offset))
+			return -1;
+	}
+
+	if (size)
+	{
+		bool read = tune ? a9l_tune_fread(tune, item->path, item->destination, size, file) :
+			1 == a9l_trace_fread(item->destination, size, 1, file);
+		if (!read)
+			return -1;
+	}
+
+	a9l_mem_zero((char*)item->destination + size, item->zero_size);
+	result->size = size;
+	result->at_end = item->size == LOAD_TO_END;
+	return 0;
+}
+
+//Bytes from the item's destination to the closest destination of another load
+//above it, or to the end of the address space
+static size_t room_after(const load_list *list, size_t index)
+{
+	uintptr_t begin = (uintptr_t)list->items[index].destination;
+	uintptr_t end = UINTPTR_MAX;
+	for (size_t i = 0; i < list->count; ++i)
+	{
+		uintptr_t other = (uintptr_t)list->items[i].destination;
+		if (i != index && other > begin && other < end)
+			end = other;
+	}
+	return (size_t)(end - begin);
+}
+
+static int apply_patch(const load_list *list, load_result results[])
+{
+	ips_region regions[LOAD_LIST_MAX_ITEMS];
+	size_t indices[LOAD_LIST_MAX_ITEMS];
+	size_t count = 0;
+
+	for (size_t i = 0; i < list->count; ++i)
+	{
+		const load_item *item = &list->items[i];
+		if (strcmp(item->path, list->patch_target) != 0)
+			continue;
+
+		regions[count].offset = item->offset;
+		regions[count].destination = item->destination;
+		regions[count].size = results[i].size;
+		//Only the tail of a file with nothing after it in memory may grow, and
+		//only up to the next load
+		regions[count].extendable = results[i].at_end && !item->zero_size;
+		regions[count].limit = regions[count].extendable ? room_after(list, i) : results[i].size;
+		indices[count++] = i;
+	}
+
+	FILE *patch = a9l_trace_fopen(list->patch_path, "rb");
+	if (!patch)
+		return -1;
+
+	int res = ips_apply(patch, regions, count);
+	a9l_trace_fclose(patch);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		results[indices[i]].size = regions[i].size;
+	}
+	return res;
+}
+
@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef LOAD_LIST_H_
+#define LOAD_LIST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "a9l_tune.h"
+
+//Maximum number of regions loaded in a single pass. Enough for a payload with
+//the maximum number of ELF segments plus every additional load an entry can
+//list.
+#define LOAD_LIST_MAX_ITEMS 48u
+
+//Read until the end of the file
+#define LOAD_TO_END SIZE_MAX
+
+typedef struct
+{
+	const char *path;
+	uint64_t offset;
+	void *destination;
+	size_t size;
+	size_t zero_size;
+} load_item;
+
+typedef struct
+{
+	load_item items[LOAD_LIST_MAX_ITEMS];
+	size_t count;
+
+	const char *open_path;
+	FILE *open_file;
+
+	const char *image_path;
+	const void *image;
+	size_t image_size;
+
+	const char *patch_target;
+	const char *patch_path;
+
+	a9l_tune *tune;
+} load_list;
+
+void load_list_initialize(load_list *list);
+
+//Hands an already open file to the list so it isn't opened a second time.
+//The list takes ownership, and closes it in load_list_run.
+void load_list_adopt_file(load_list *list, const char *path, FILE *file);
+
+//Serves every load from path out of image, a copy of the whole file already in
+//memory, instead of reading the file. These loads are done before any others,
+//so only they can clobber the image.
+void load_list_set_image(load_list *list, const char *path, const void *image, size_t image_size);
+
+//Applies the IPS patch at patch to the contents of target once they are in
+//memory, before cache maintenance.
+void load_list_set_patch(load_list *list, const char *target, const char *patch);
+
+//Reads files in chunks of the size tuned for their drive, and keeps tuning.
+//Without this, every load is read with a single fread.
+void load_list_set_tuning(load_list *list, a9l_tune *tune);
+
+//Whether any load queued from path writes to [start, start + size)
+bool load_list_overlaps(const load_list *list, const char *path, const void *start, size_t size);
+
+//Seeks file to position from its start, in steps small enough for fseek's
+//long offset. Returns 0 on success.
+int load_list_set_position(FILE *file, uint64_t position);
+
+//Queues size bytes from path at offset to be placed at destination, followed
+//by zero_size bytes of zeroes. Returns 0 on success.
+int load_list_add(load_list *list, const char *path, uint64_t offset, void *destination, size_t size, size_t zero_size);
+
+//Loads everything queued in one pass. Loads are grouped by drive and file and
+//issued in increasing file offset order, so each file is opened once and read
+//front to back. Cache maintenance for all the loaded regions is done once at
+//the end. Nothing is loaded if any two loads would overlap in memory. Returns 0
+//on success.
+int load_list_run(load_list *list);
+
+#endif//LOAD_LIST_H_
+
@@ -7,6 +7,13 @@
  ******************************************************************************/
 
 #include "a9l_config.h"
+#include "a9l_trace.h"
+#include "a9l_memo.h"
+#include "a9l_location.h"
+#include "a9l_select.h"
+#include "a9l_mem.h"
+#include "a9l_resident.h"
+#include "a9l_prefetch.h"
 
 #include <ctr9/io.h>
 #include <ctr9/ctr_system.h>
@@ -25,26 +32,18 @@
 #define A9L_ADDR 0x20010000u
 
 static void on_error(const char *error);
-static const a9l_config_entry* select_payload(const a9l_config *config, ctr_hid_button_type buttons);
-static const char *find_file(const char *path, const char* drives[], size_t number_of_drives);
 
 static void initialize_io(void);
 static void load_bootloader(void);
-static void handle_payload(char *path, size_t path_size, size_t *offset, ctr_hid_button_type buttons_pressed);
+static void handle_payload(a9l_selection *selection, ctr_hid_button_type buttons_pressed);
 
-static uint8_t otp_sha[32];
+static uint8_t otp_sha[32] __attribute__((aligned(4)));
 
-inline static void vol_memcpy(volatile void *dest, volatile void *sorc, size_t size)
-{
-	volatile uint8_t *dst = dest;
-	volatile uint8_t *src = sorc;
-	while(size--)
-		dst[size] = src[size];
-}
+static const char *all_drives[] = { "SD:", "CTRNAND:", "TWLN:", "TWLP:" };
 
 static void __attribute__((constructor)) save_hash(void)
 {
-	vol_memcpy(otp_sha, REG_SHAHASH, 32);
+	a9l_mem_copy_volatile(otp_sha, REG_SHAHASH, 32);
 }
 
 void ctr_libctr9_init(void);
@@ -54,20 +53,29 @@ int main()
 	//Before anything else, immediately record the buttons to use for boot
 	ctr_hid_button_type buttons_pressed = ctr_hid_get_buttons();
 
+	a9l_trace_initialize();
+
 	//IO initialization
 	initialize_io();
 
 	load_bootloader();
 
-	char payload[256] = { 0 };
-	size_t offset;
-	handle_payload(payload, sizeof(payload), &offset, buttons_pressed);
+	//On the stack, as the payload may be loaded over the loader
+	a9l_selection selection;
+	handle_payload(&selection, buttons_pressed);
 	char offset_text[256] = {0};
 
-	snprintf(offset_text, 255, "%zu", offset);
+	snprintf(offset_text, 255, "%zu", selection.offset);
 
 	printf("Jumping to bootloader...\n");
-	const char *args[] = { payload, offset_text, (const char*)otp_sha };
+	const char *args[4 + 3 * A9L_CONFIG_MAX_LOADS] = { selection.payload, offset_text, (const char*)otp_sha, selection.patch };
+	int num_args = 4;
+	for (size_t i = 0; i < selection.num_loads; ++i)
+	{
+		args[num_args++] = selection.loads[i].location;
+		args[num_args++] = selection.loads[i].offset;
+		args[num_args++] = selection.loads[i].address;
+	}
 
 	//Bootloader has been cleaned to memory, and whatever is in the stack is safe
 	//since the bootloader doesn't flush the cache without cleaning. Just for
@@ -75,7 +83,7 @@ int main()
 	ctr_cache_drain_write_buffer();
 
 	//Jump to bootloader
-	int bootloader_result = ((int(*)(int, const char*[]))A9L_ADDR)(3, args);
+	int bootloader_result = ((int(*)(int, const char*[]))A9L_ADDR)(num_args, args);
 
 	//Re-init screen structures in case bootloader altered the memory controlling
 	//it.
@@ -99,46 +107,18 @@ void on_error(const char *error)
 	ctr_system_poweroff();
 }
 
-const a9l_config_entry* select_payload(const a9l_config *config, ctr_hid_button_type buttons)
-{
-	size_t num_of_entries = a9l_config_get_number_of_entries(config);
-	for (size_t i = 0; i < num_of_entries; ++i)
-	{
-		a9l_config_entry *entry = a9l_config_get_entry(config, i);
-		if (entry->buttons == buttons)
-		{
-			return entry;
-		}
-	}
-	return NULL;
-}
-
-static const char *find_file(const char *path, const char* drives[], size_t number_of_drives)
-{
-	for (size_t i = 0; i < number_of_drives; ++i)
-	{
-		ctr_drives_chdrive(drives[i]);
-		struct stat st;
-		if (stat(path, &st) == 0)
-		{
-			return drives[i];
-		}
-	}
-	return NULL;
-}
-
 static void initialize_io(void)
 {
-	int result = ctr_drives_check_ready("CTRNAND:");
-	result |= ctr_drives_check_ready("TWLN:");
-	result |= ctr_drives_check_ready("TWLP:");
+	int result = a9l_trace_check_ready("CTRNAND:");
+	result |= a9l_trace_check_ready("TWLN:");
+	result |= a9l_trace_check_ready("TWLP:");
 
 	if (result)
 	{
 		on_error("Failed to initialize internal IO system!");
 	}
 
-	result = ctr_drives_check_ready("SD:");
+	result = a9l_trace_check_ready("SD:");
 	if (result && ctr_sd_interface_inserted())
 	{
 		on_error("SD card detected but failed to initialize it!");
@@ -147,87 +127,89 @@ static void initialize_io(void)
 
 static void load_bootloader(void)
 {
-	const char *drives[] = {"SD:", "CTRNAND:", "TWLN:", "TWLP:" };
-	const char * drive = find_file("/arm9launcher.bin", drives, 4);
+	const char * drive = a9l_location_find_file("/arm9launcher.bin", all_drives, 4);
 	if (!drive)
 	{
 		on_error("Unable to find bootloader file!");
 	}
 
-	ctr_drives_chdrive(drive);
-	FILE *bootloader = fopen("/arm9launcher.bin", "rb");
+	a9l_trace_chdrive(drive);
+	FILE *bootloader = a9l_trace_fopen("/arm9launcher.bin", "rb");
 	if (bootloader == NULL)
 	{
 		on_error("Failed to open bootloader file!");
 	}
 
 	struct stat st;
-	fstat(fileno(bootloader), &st);
+	a9l_trace_fstat(bootloader, &st);
 	size_t bootloader_size = (size_t)st.st_size;//FIXME we should limit the size...
-	fread((void*)A9L_ADDR, bootloader_size, 1, bootloader);
-	fclose(bootloader);
+	a9l_trace_fread((void*)A9L_ADDR, bootloader_size, 1, bootloader);
+	a9l_trace_fclose(bootloader);
 
 	//Make sure the bootloader makes it to memory
 	ctr_cache_clean_data_range((void*)A9L_ADDR, (void*)(A9L_ADDR + bootloader_size));
 	ctr_cache_flush_instruction_range((void*)A9L_ADDR, (void*)(A9L_ADDR + bootloader_size));
 }
 
-static void handle_payload(char *path, size_t path_size, size_t *offset, ctr_hid_button_type buttons_pressed)
+static void handle_payload(a9l_selection *selection, ctr_hid_button_type buttons_pressed)
 {
 	FILE *config_file;
-	const char *drives[] = { "SD:", "CTRNAND:", "TWLN:", "TWLP:" };
-	const char* drive = find_file("/arm9launcher.cfg", drives, 4);
+	const char* drive = a9l_location_find_file("/arm9launcher.cfg", all_drives, 4);
 	if (!drive)
 	{
 		on_error("Unable to find configuration file!");
 	}
 
-	ctr_drives_chdrive(drive);
-	config_file = fopen("/arm9launcher.cfg", "rb");
+	a9l_trace_chdrive(drive);
+	config_file = a9l_trace_fopen("/arm9launcher.cfg", "rb");
 	if (config_file == NULL)
 	{
 		on_error("Failed to open bootloader config!");
 	}
 
 	struct stat st = { 0 };
-	fstat(fileno(config_file), &st);
-
-	size_t buffer_size = (size_t)(st.st_size) + 1; //FIXME we should limit the size...
-	char *buffer = malloc(buffer_size);
-	fread(buffer, buffer_size - 1, 1, config_file);
-	fclose(config_file);
+	a9l_trace_fstat(config_file, &st);
 
-	buffer[buffer_size-1] = '\0'; //Make sure buffer, which should be all text, is null terminated.
-
-	//Parse configuration and make sense of it
-	a9l_config config = { 0 };
-
-	if (!a9l_config_read_json(&config, buffer))
+	if ((size_t)st.st_size > A9L_CONFIG_MAX_SIZE)
 	{
-		free(buffer);
-		on_error("Failed to parse JSON configuration file");
+		a9l_trace_fclose(config_file);
+		on_error("Configuration file is too large!");
 	}
-	free(buffer);
 
-	//Using a fixed buffer because this will be passed to bootloader via the stack.
-	const a9l_config_entry *entry = select_payload(&config, buttons_pressed);
-	if (entry)
+	size_t buffer_size = (size_t)(st.st_size) + 1;
+	char *buffer = malloc(buffer_size);
+	if (!buffer)
 	{
-		size_t payload_len = strlen(entry->payload) + 1;
-		if (payload_len > path_size)
-		{
-			on_error("Payload text string in configuration is too long!");
-		}
-		strncpy(path, entry->payload, payload_len);
+		on_error("Failed to allocate memory for the configuration!");
 	}
-	else
+	a9l_trace_fread(buffer, buffer_size - 1, 1, config_file);
+	a9l_trace_fclose(config_file);
+
+	buffer[buffer_size-1] = '\0'; //Make sure buffer, which should be all text, is null terminated.
+
+	//The configuration is always read, but only parsed if it or the buttons
+	//changed since the last boot
+	a9l_memo memo;
+	a9l_memo_read(&memo, A9L_MEMO_FILE);
+#ifdef A9L_PREFETCH
+	//Start on the payload the last boot selected while this one's is resolved
+	a9l_resident cache;
+	a9l_resident_initialize(&cache, (void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE);
+	a9l_prefetch prefetch;
+	a9l_prefetch_start(&prefetch, &cache, memo.has_selection ? memo.selection.payload : NULL);
+#endif
+	const char *error;
+	bool selected = a9l_select(selection, &memo, drive, buffer, buffer_size - 1, buttons_pressed, &error);
+	free(buffer);
+#ifdef A9L_PREFETCH
+	a9l_prefetch_finish(&prefetch, selected ? selection->payload : NULL);
+#endif
+	if (!selected)
 	{
-		on_error("Failed to identify payload to launch");
+		on_error(error);
 	}
 
-	*offset = entry->offset;
-
-	//Done with configuration, ready to jump
-	a9l_config_destroy(&config);
+	//Only written if the selection or a remembered location changed
+	a9l_memo_write(&memo, A9L_MEMO_FILE);
 }
 
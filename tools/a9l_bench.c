@@ -0,0 +1,518 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host side benchmark driver for corpora made by a9l_corpus. Runs the
+//configuration parser, payload selection, and the raw and ELF payload loading
+//steps over every input in the corpus and writes one tab separated result per
+//benchmark. Two result files can then be compared, flagging any benchmark that
+//got slower by more than a threshold.
+//
+//Everything benchmarked is the real code from src/, built against the host
+//layer in tools/host/: the configuration parser, a9l_config_find_entry, and
+//load_header, check_elf, queue_segments and load_list_run for the payloads.
+//The ARM9 addresses payloads are loaded to are mapped on the host, so the
+//loaders write where they would on the console.
+//
+//Build with:
+//  make -C tools a9l_bench
+
+#include "a9l_config.h"
+#include "elf.h"
+#include "load_list.h"
+#include "a9l_trace.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define ARRAY_SIZE(X) (sizeof(X)/sizeof(*X))
+
+#define A9L_BENCH_VERSION 2
+#define A9L_BENCH_BATCHES 15
+//Without -n, each batch runs enough iterations to take at least this long
+#define A9L_BENCH_BATCH_NS 20e6
+#define A9L_BENCH_MAX_ITERATIONS 1000000ul
+//Most noise, in percent, that excuses a slowdown past the threshold
+#define A9L_BENCH_NOISE_CEILING 25.0
+#define A9L_BENCH_MAX_RESULTS 256
+
+//FCRAM, where payloads are loaded to, and where src/arm9launcher.c puts raw
+//payloads
+#define FCRAM_ADDRESS 0x20000000u
+#define FCRAM_SIZE 0x08000000u
+#define PAYLOAD_ADDRESS 0x23F00000u
+
+typedef struct
+{
+	char name[128];
+	double ns_per_op;
+	unsigned long iterations;
+	//How much slower the median batch was than the fastest, in percent
+	double noise;
+} bench_result;
+
+typedef struct
+{
+	bench_result results[A9L_BENCH_MAX_RESULTS];
+	size_t count;
+} bench_results;
+
+typedef bool (*bench_function)(const char *path, uint64_t offset, void *data);
+
+//A benchmark, and the times of its batches so far
+typedef struct
+{
+	char name[128];
+	char path[1024];
+	uint64_t offset;
+	bench_function function;
+	void *data;
+	unsigned long iterations;
+	double times[A9L_BENCH_BATCHES];
+} bench_job;
+
+static double now_ns(void);
+static int compare_doubles(const void *a, const void *b);
+static char *read_text(const char *path);
+static bool add_job(bench_job jobs[], size_t *count, const char *name, bench_function function, const char *path, uint64_t offset, void *data);
+static bool run_batch(bench_job *job, unsigned long iterations, double *elapsed);
+static bool calibrate(bench_job *job, unsigned long iterations);
+static void finish_job(bench_job *job, bench_result *result);
+static bool bench_parse(const char *path, uint64_t offset, void *data);
+static bool bench_select(const char *path, uint64_t offset, void *data);
+static bool bench_raw(const char *path, uint64_t offset, void *data);
+static bool bench_elf(const char *path, uint64_t offset, void *data);
+static bool drive_path(const char *corpus, const char *file, char *path, size_t size);
+static int run(const char *corpus, const char *output, unsigned long iterations);
+static bool read_results(bench_results *results, const char *path);
+static int compare(const char *base_path, const char *new_path, double threshold);
+static void usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+	unsigned long iterations = 0;
+	double threshold = 10.0;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:t:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				iterations = strtoul(optarg, NULL, 0);
+				break;
+			case 't':
+				threshold = strtod(optarg, NULL);
+				break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	int remaining = argc - optind;
+	if (remaining >= 2 && strcmp(argv[optind], "run") == 0 && remaining <= 3)
+	{
+		return run(argv[optind + 1], remaining == 3 ? argv[optind + 2] : NULL, iterations);
+	}
+	else if (remaining == 3 && strcmp(argv[optind], "compare") == 0 && threshold >= 0.0)
+	{
+		return compare(argv[optind + 1], argv[optind + 2], threshold);
+	}
+
+	usage(argv[0]);
+	return EXIT_FAILURE;
+}
+
+//Helper functions follow
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *read_text(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+
+	struct stat st;
+	char *buffer = NULL;
+	if (fstat(fileno(file), &st) == 0 && (buffer = malloc((size_t)st.st_size + 1)))
+	{
+		if (fread(buffer, 1, (size_t)st.st_size, file) != (size_t)st.st_size)
+		{
+			free(buffer);
+			buffer = NULL;
+		}
+		else
+		{
+			buffer[st.st_size] = '\0';
+		}
+	}
+	fclose(file);
+	return buffer;
+}
+
+static bool add_job(bench_job jobs[], size_t *count, const char *name, bench_function function, const char *path, uint64_t offset, void *data)
+{
+	if (*count >= A9L_BENCH_MAX_RESULTS)
+		return false;
+
+	bench_job *job = &jobs[(*count)++];
+	snprintf(job->name, sizeof(job->name), "%s", name);
+	snprintf(job->path, sizeof(job->path), "%s", path);
+	job->offset = offset;
+	job->function = function;
+	job->data = data;
+	job->iterations = 0;
+	return true;
+}
+
+//Sets elapsed to the time per call of iterations calls, in ns
+static bool run_batch(bench_job *job, unsigned long iterations, double *elapsed)
+{
+	double start = now_ns();
+	for (unsigned long i = 0; i < iterations; ++i)
+	{
+		if (!job->function(job->path, job->offset, job->data))
+		{
+			fprintf(stderr, "%s: failed on %s\n", job->name, job->path);
+			return false;
+		}
+	}
+	*elapsed = (now_ns() - start) / (double)iterations;
+	return true;
+}
+
+//With no iterations given, a first call picks enough to fill a batch, so fast
+//benchmarks aren't dominated by timer and scheduling noise and slow ones don't
+//take minutes
+static bool calibrate(bench_job *job, unsigned long iterations)
+{
+	double single;
+	if (!run_batch(job, 1, &single))
+		return false;
+
+	if (iterations)
+		job->iterations = iterations;
+	else if (single >= A9L_BENCH_BATCH_NS)
+		job->iterations = 1;
+	else if (single * (double)A9L_BENCH_MAX_ITERATIONS < A9L_BENCH_BATCH_NS)
+		job->iterations = A9L_BENCH_MAX_ITERATIONS;
+	else
+		job->iterations = (unsigned long)(A9L_BENCH_BATCH_NS / single) + 1;
+	return true;
+}
+
+//Keeps the fastest batch. The spread between the fastest and the median batch
+//is kept as a measure of the noise that is left.
+static void finish_job(bench_job *job, bench_result *result)
+{
+	qsort(job->times, A9L_BENCH_BATCHES, sizeof(*job->times), compare_doubles);
+	snprintf(result->name, sizeof(result->name), "%s", job->name);
+	result->ns_per_op = job->times[0];
+	result->iterations = job->iterations;
+	result->noise = job->times[0] > 0.0 ?
+		(job->times[A9L_BENCH_BATCHES / 2] - job->times[0]) * 100.0 / job->times[0] : 0.0;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double left = *(const double*)a;
+	double right = *(const double*)b;
+	return (left > right) - (left < right);
+}
+
+//Same steps as handle_payload in src/loader.c: read the file, then parse it
+static bool bench_parse(const char *path, uint64_t offset, void *data)
+{
+	(void)offset;
+	(void)data;
+	char *text = read_text(path);
+	if (!text)
+		return false;
+
+	a9l_config config = { 0 };
+	bool ok = a9l_config_read_json(&config, text);
+	free(text);
+	if (ok)
+		a9l_config_destroy(&config);
+	return ok;
+}
+
+//Selects the "None" entry, which the corpus always places last
+static bool bench_select(const char *path, uint64_t offset, void *data)
+{
+	(void)path;
+	(void)offset;
+	return a9l_config_find_entry(data, CTR_HID_NONE) != NULL;
+}
+
+//The raw payload path of src/arm9launcher.c
+static bool bench_raw(const char *path, uint64_t offset, void *data)
+{
+	(void)data;
+	FILE *file = a9l_trace_fopen(path, "rb");
+	if (!file)
+		return false;
+
+	Elf32_Ehdr header;
+	load_header(&header, file);
+
+	load_list list;
+	load_list_initialize(&list);
+	if (check_elf(&header) || load_list_add(&list, path, offset, (void*)PAYLOAD_ADDRESS, LOAD_TO_END, 0))
+	{
+		a9l_trace_fclose(file);
+		return false;
+	}
+	load_list_adopt_file(&list, path, file);
+	return load_list_run(&list) == 0;
+}
+
+//The ELF payload path of src/arm9launcher.c
+static bool bench_elf(const char *path, uint64_t offset, void *data)
+{
+	(void)offset;
+	(void)data;
+	FILE *file = a9l_trace_fopen(path, "rb");
+	if (!file)
+		return false;
+
+	Elf32_Ehdr header;
+	load_header(&header, file);
+
+	load_list list;
+	load_list_initialize(&list);
+	if (!check_elf(&header) || queue_segments(&header, file, path, &list))
+	{
+		a9l_trace_fclose(file);
+		return false;
+	}
+	load_list_adopt_file(&list, path, file);
+	return load_list_run(&list) == 0;
+}
+
+//Corpus files are under a directory per drive, e.g. SD/corpus/raw_0.bin. Maps
+//the drive to its directory and writes the drive path, SD:/corpus/raw_0.bin.
+static bool drive_path(const char *corpus, const char *file, char *path, size_t size)
+{
+	const char *slash = strchr(file, '/');
+	if (!slash || (size_t)(slash - file) >= 15)
+		return false;
+
+	char drive[16], directory[1024];
+	snprintf(drive, sizeof(drive), "%.*s:", (int)(slash - file), file);
+	snprintf(directory, sizeof(directory), "%s/%.*s", corpus, (int)(slash - file), file);
+	int res = snprintf(path, size, "%s%s", drive, slash);
+	return a9l_host_map_drive(drive, directory) && res > 0 && (size_t)res < size;
+}
+
+static int run(const char *corpus, const char *output, unsigned long iterations)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/corpus.txt", corpus);
+	FILE *manifest = fopen(path, "r");
+	if (!manifest)
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+
+	static bool mapped;
+	if (!mapped && !(mapped = a9l_host_map_memory(FCRAM_ADDRESS, FCRAM_SIZE)))
+	{
+		fprintf(stderr, "Unable to map the ARM9 addresses on this host\n");
+		fclose(manifest);
+		return EXIT_FAILURE;
+	}
+	a9l_host_reset();
+
+	static bench_results results;
+	static bench_job jobs[A9L_BENCH_MAX_RESULTS];
+	static a9l_config configs[A9L_BENCH_MAX_RESULTS];
+	size_t num_jobs = 0, num_configs = 0;
+	bool ok = true;
+
+	char line[1024];
+	while (ok && fgets(line, sizeof(line), manifest))
+	{
+		char type[8], file[512];
+		uint64_t offset, size;
+		if (line[0] == '#' || sscanf(line, "%7s %511s %" SCNu64 " %" SCNu64, type, file, &offset, &size) != 4)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", corpus, file);
+		const char *base = strrchr(file, '/');
+		base = base ? base + 1 : file;
+		char name[128];
+
+		if (strcmp(type, "cfg") == 0)
+		{
+			char *text = read_text(path);
+			a9l_config *config = &configs[num_configs];
+			memset(config, 0, sizeof(*config));
+			ok = text && a9l_config_read_json(config, text);
+			free(text);
+			num_configs += ok;
+			if (!ok || a9l_config_get_number_of_entries(config) != size)
+			{
+				fprintf(stderr, "%s: failed to parse\n", path);
+				ok = false;
+				break;
+			}
+
+			snprintf(name, sizeof(name), "parse/%.100s", base);
+			ok = add_job(jobs, &num_jobs, name, bench_parse, path, 0, NULL);
+			snprintf(name, sizeof(name), "select/%.100s", base);
+			ok = ok && add_job(jobs, &num_jobs, name, bench_select, path, 0, config);
+		}
+		else if (strcmp(type, "raw") == 0 || strcmp(type, "elf") == 0)
+		{
+			bool raw = strcmp(type, "raw") == 0;
+			snprintf(name, sizeof(name), "load_%s/%.100s", type, base);
+			ok = drive_path(corpus, file, path, sizeof(path)) &&
+				add_job(jobs, &num_jobs, name, raw ? bench_raw : bench_elf, path, offset, NULL);
+		}
+	}
+	fclose(manifest);
+
+	//Batches go round robin over the benchmarks, so a stretch of time where
+	//the host is slower is spread over all of them instead of skewing a few
+	for (size_t i = 0; i < num_jobs && ok; ++i)
+		ok = calibrate(&jobs[i], iterations);
+	for (size_t batch = 0; batch < A9L_BENCH_BATCHES && ok; ++batch)
+	{
+		for (size_t i = 0; i < num_jobs && ok; ++i)
+			ok = run_batch(&jobs[i], jobs[i].iterations, &jobs[i].times[batch]);
+	}
+	for (size_t i = 0; i < num_jobs && ok; ++i)
+		finish_job(&jobs[i], &results.results[results.count++]);
+
+	for (size_t i = 0; i < num_configs; ++i)
+		a9l_config_destroy(&configs[i]);
+
+	if (!ok)
+		return EXIT_FAILURE;
+
+	FILE *out = output ? fopen(output, "w") : stdout;
+	if (!out)
+	{
+		perror(output);
+		return EXIT_FAILURE;
+	}
+	fprintf(out, "#a9l_bench %d\n#name\tns_per_op\titerations\tnoise_percent\n", A9L_BENCH_VERSION);
+	for (size_t i = 0; i < results.count; ++i)
+	{
+		fprintf(out, "%s\t%.1f\t%lu\t%.1f\n", results.results[i].name,
+			results.results[i].ns_per_op, results.results[i].iterations, results.results[i].noise);
+	}
+	if (output && fclose(out))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+static bool read_results(bench_results *results, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+	{
+		perror(path);
+		return false;
+	}
+
+	char line[256];
+	int version = 0;
+	results->count = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		if (sscanf(line, "#a9l_bench %d", &version) == 1 || line[0] == '#')
+			continue;
+
+		bench_result result;
+		if (sscanf(line, "%127s %lf %lu %lf", result.name, &result.ns_per_op, &result.iterations, &result.noise) != 4)
+			continue;
+		if (results->count < ARRAY_SIZE(results->results))
+			results->results[results->count++] = result;
+	}
+	fclose(file);
+
+	if (version != A9L_BENCH_VERSION)
+	{
+		fprintf(stderr, "%s: not a version %d result file\n", path, A9L_BENCH_VERSION);
+		return false;
+	}
+	return true;
+}
+
+//Reports every benchmark in both files. Returns 1 if any regressed by more than
+//threshold percent. A benchmark whose batches were spread out in either run
+//has to regress by more than the larger spread too, so a noisy host doesn't
+//flag regressions that aren't there, but no more than A9L_BENCH_NOISE_CEILING
+//so a noisy run can't hide any regression.
+static int compare(const char *base_path, const char *new_path, double threshold)
+{
+	static bench_results base, current;
+	if (!read_results(&base, base_path) || !read_results(&current, new_path))
+		return EXIT_FAILURE;
+
+	size_t regressions = 0;
+	printf("#name\tbase_ns\tnew_ns\tchange_percent\tlimit_percent\tstatus\n");
+	for (size_t i = 0; i < current.count; ++i)
+	{
+		const bench_result *now = &current.results[i];
+		const bench_result *before = NULL;
+		for (size_t j = 0; j < base.count && !before; ++j)
+		{
+			if (strcmp(base.results[j].name, now->name) == 0)
+				before = &base.results[j];
+		}
+
+		if (!before)
+		{
+			printf("%s\t-\t%.1f\t-\t-\tnew\n", now->name, now->ns_per_op);
+			continue;
+		}
+
+		double change = before->ns_per_op > 0.0 ?
+			(now->ns_per_op - before->ns_per_op) * 100.0 / before->ns_per_op : 0.0;
+		double limit = before->noise > now->noise ? before->noise : now->noise;
+		if (limit > A9L_BENCH_NOISE_CEILING)
+			limit = A9L_BENCH_NOISE_CEILING;
+		if (limit < threshold)
+			limit = threshold;
+		bool regressed = change > limit;
+		regressions += regressed;
+		printf("%s\t%.1f\t%.1f\t%+.1f\t%.1f\t%s\n", now->name, before->ns_per_op,
+			now->ns_per_op, change, limit, regressed ? "REGRESSION" : "ok");
+	}
+
+	fprintf(stderr, "%zu regression(s) above %.1f%%\n", regressions, threshold);
+	return regressions ? 1 : EXIT_SUCCESS;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-n ITERATIONS] run CORPUS_DIR [RESULTS]\n"
+		"       %s [-t PERCENT] compare BASE_RESULTS NEW_RESULTS\n"
+		"  -n  iterations per timed batch (enough for 20 ms)\n"
+		"  -t  slowdown in percent above which a benchmark is a regression (10)\n",
+		name, name);
+}
+
@@ -0,0 +1,346 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host side generator for a synthetic benchmark corpus. Writes configurations
+//of 1 to 512 entries in the arm9launcher.cfg schema, raw payloads stored at
+//various offsets into their files, and multi-segment ARM ELF payloads, so
+//boot path changes can be measured on the same inputs with a9l_bench. The
+//output is deterministic for a given seed.
+//
+//Layout of the generated corpus:
+//  DIR/SD/arm9launcher_N.cfg  configuration with N entries
+//  DIR/SD/corpus/raw_I.bin    raw payloads
+//  DIR/SD/corpus/elf_I.elf    ELF payloads
+//  DIR/corpus.txt             manifest of payloads, read by a9l_bench
+//
+//DIR/SD can be passed to a9l_replay as the SD: drive image.
+//
+//Build with:
+//  cc -std=gnu11 -O2 -o a9l_corpus tools/a9l_corpus.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define ARRAY_SIZE(X) (sizeof(X)/sizeof(*X))
+
+//ELF constants used by check_elf() in src/elf.c
+#define ELF_HEADER_SIZE 52u
+#define ELF_PROGRAM_HEADER_SIZE 32u
+#define ELF_ET_EXEC 2u
+#define ELF_EM_ARM 40u
+#define ELF_EV_CURRENT 1u
+#define ELF_PT_LOAD 1u
+#define ELF_PT_NOTE 4u
+#define ELF_PT_GNU_STACK 0x6474E551u
+
+//Payloads are placed where arm9launcher would put them
+#define PAYLOAD_ADDRESS 0x23F00000u
+#define ELF_BASE_ADDRESS 0x20000000u
+
+static const size_t config_sizes[] = { 1, 10, 100, 512 };
+static const uint32_t raw_offsets[] = { 0, 0x200, 0x12000, 0x40000 };
+static const char *button_names[] = {
+	"A", "B", "Select", "Start", "Right", "Left", "Up", "Down", "R", "L", "X", "Y"
+};
+
+static uint64_t rng_state;
+
+static uint32_t rng_next(void);
+static uint32_t rng_range(uint32_t low, uint32_t high);
+static bool write_bytes(FILE *file, const void *data, size_t size);
+static bool write_random(FILE *file, size_t size);
+static void put_le16(uint8_t *buffer, uint16_t value);
+static void put_le32(uint8_t *buffer, uint32_t value);
+static bool make_directory(const char *path);
+static bool generate_raw(const char *path, uint32_t offset, uint32_t size);
+static bool generate_elf(const char *path, unsigned segments, uint32_t *file_size);
+static bool generate_config(const char *path, size_t entries, size_t num_raw, size_t num_elf);
+static void usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+	unsigned long seed = 1;
+	size_t num_raw = 8, num_elf = 8;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:r:e:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				num_raw = strtoul(optarg, NULL, 0);
+				break;
+			case 'e':
+				num_elf = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1 || !num_raw || !num_elf)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	rng_state = seed ? seed : 1;
+
+	const char *base = argv[optind];
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/SD", base);
+	bool ok = make_directory(base) && make_directory(path);
+	snprintf(path, sizeof(path), "%s/SD/corpus", base);
+	ok = ok && make_directory(path);
+	if (!ok)
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), "%s/corpus.txt", base);
+	FILE *manifest = fopen(path, "w");
+	if (!manifest)
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	fprintf(manifest, "#type path offset size\n");
+
+	for (size_t i = 0; i < num_raw && ok; ++i)
+	{
+		uint32_t offset = raw_offsets[i % ARRAY_SIZE(raw_offsets)];
+		//Payloads from a few KiB up to the 1 MiB below the loader
+		uint32_t size = rng_range(4u, 1024u) * 1024u;
+		snprintf(path, sizeof(path), "%s/SD/corpus/raw_%zu.bin", base, i);
+		ok = generate_raw(path, offset, size);
+		fprintf(manifest, "raw SD/corpus/raw_%zu.bin %" PRIu32 " %" PRIu32 "\n", i, offset, size);
+	}
+
+	for (size_t i = 0; i < num_elf && ok; ++i)
+	{
+		unsigned segments = 2u + (unsigned)(i % 7u);
+		uint32_t size = 0;
+		snprintf(path, sizeof(path), "%s/SD/corpus/elf_%zu.elf", base, i);
+		ok = generate_elf(path, segments, &size);
+		fprintf(manifest, "elf SD/corpus/elf_%zu.elf 0 %" PRIu32 "\n", i, size);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(config_sizes) && ok; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/SD/arm9launcher_%zu.cfg", base, config_sizes[i]);
+		ok = generate_config(path, config_sizes[i], num_raw, num_elf);
+		fprintf(manifest, "cfg SD/arm9launcher_%zu.cfg 0 %zu\n", config_sizes[i], config_sizes[i]);
+	}
+
+	if (fclose(manifest) || !ok)
+	{
+		fprintf(stderr, "failed to write corpus to %s\n", base);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+//Helper functions follow
+
+//xorshift64*, so corpora are identical across hosts for the same seed
+static uint32_t rng_next(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (uint32_t)((rng_state * 2685821657736338717ull) >> 32);
+}
+
+static uint32_t rng_range(uint32_t low, uint32_t high)
+{
+	return low + rng_next() % (high - low + 1u);
+}
+
+static bool write_bytes(FILE *file, const void *data, size_t size)
+{
+	return fwrite(data, 1, size, file) == size;
+}
+
+static bool write_random(FILE *file, size_t size)
+{
+	uint8_t buffer[4096];
+	while (size)
+	{
+		size_t amount = size < sizeof(buffer) ? size : sizeof(buffer);
+		for (size_t i = 0; i < amount; i += 4)
+		{
+			uint32_t value = rng_next();
+			memcpy(&buffer[i], &value, amount - i < 4 ? amount - i : 4);
+		}
+		if (!write_bytes(file, buffer, amount))
+			return false;
+		size -= amount;
+	}
+	return true;
+}
+
+static void put_le16(uint8_t *buffer, uint16_t value)
+{
+	buffer[0] = (uint8_t)value;
+	buffer[1] = (uint8_t)(value >> 8);
+}
+
+static void put_le32(uint8_t *buffer, uint32_t value)
+{
+	for (size_t i = 0; i < 4; ++i)
+		buffer[i] = (uint8_t)(value >> (8 * i));
+}
+
+static bool make_directory(const char *path)
+{
+	return mkdir(path, 0755) == 0 || access(path, W_OK) == 0;
+}
+
+//Raw payloads are preceded by offset bytes of unrelated data, like Cakes.dat
+static bool generate_raw(const char *path, uint32_t offset, uint32_t size)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+	bool ok = write_random(file, offset) && write_random(file, size);
+	return !fclose(file) && ok;
+}
+
+//Writes an ELF with the given number of PT_LOAD segments, some with .bss style
+//zero fill, plus non-loadable headers that the loader must skip.
+static bool generate_elf(const char *path, unsigned segments, uint32_t *file_size)
+{
+	unsigned num_headers = segments + 2u;
+	uint32_t data_offset = ELF_HEADER_SIZE + ELF_PROGRAM_HEADER_SIZE * num_headers;
+	data_offset = (data_offset + 0xFFFu) & ~0xFFFu;
+
+	uint8_t header[ELF_HEADER_SIZE] = { 0x7F, 'E', 'L', 'F', 1, 1, ELF_EV_CURRENT };
+	put_le16(&header[16], ELF_ET_EXEC);
+	put_le16(&header[18], ELF_EM_ARM);
+	put_le32(&header[20], ELF_EV_CURRENT);
+	put_le32(&header[24], ELF_BASE_ADDRESS);
+	put_le32(&header[28], ELF_HEADER_SIZE);
+	put_le16(&header[40], ELF_HEADER_SIZE);
+	put_le16(&header[42], ELF_PROGRAM_HEADER_SIZE);
+	put_le16(&header[44], (uint16_t)num_headers);
+
+	uint8_t program_headers[ELF_PROGRAM_HEADER_SIZE * 16] = { 0 };
+	uint32_t sizes[16];
+	uint32_t offset = data_offset;
+	uint32_t address = ELF_BASE_ADDRESS;
+	for (unsigned i = 0; i < segments; ++i)
+	{
+		uint8_t *ph = &program_headers[ELF_PROGRAM_HEADER_SIZE * i];
+		uint32_t size = rng_range(1u, 128u) * 1024u;
+		uint32_t zero = (i % 3u == 2u) ? rng_range(1u, 64u) * 1024u : 0;
+		put_le32(&ph[0], ELF_PT_LOAD);
+		put_le32(&ph[4], offset);
+		put_le32(&ph[8], address);
+		put_le32(&ph[12], address);
+		put_le32(&ph[16], size);
+		put_le32(&ph[20], size + zero);
+		put_le32(&ph[24], 7);
+		put_le32(&ph[28], 0x1000);
+		sizes[i] = size;
+		offset += size;
+		address += (size + zero + 0xFFFu) & ~0xFFFu;
+	}
+	put_le32(&program_headers[ELF_PROGRAM_HEADER_SIZE * segments], ELF_PT_NOTE);
+	put_le32(&program_headers[ELF_PROGRAM_HEADER_SIZE * segments + 4], ELF_HEADER_SIZE);
+	put_le32(&program_headers[ELF_PROGRAM_HEADER_SIZE * (segments + 1)], ELF_PT_GNU_STACK);
+
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	uint8_t padding[0x1000] = { 0 };
+	size_t headers_size = ELF_PROGRAM_HEADER_SIZE * num_headers;
+	bool ok = write_bytes(file, header, sizeof(header)) &&
+		write_bytes(file, program_headers, headers_size) &&
+		write_bytes(file, padding, data_offset - ELF_HEADER_SIZE - headers_size);
+	for (unsigned i = 0; i < segments && ok; ++i)
+		ok = write_random(file, sizes[i]);
+
+	*file_size = offset;
+	return !fclose(file) && ok;
+}
+
+//Entries cycle through the generated payloads. Some use location arrays and
+//additional loads, but the average entry is kept small enough that the most
+//entries the parser accepts stay within its size and token limits too.
+static bool generate_config(const char *path, size_t entries, size_t num_raw, size_t num_elf)
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "{\"configuration\":[\n");
+	for (size_t i = 0; i < entries; ++i)
+	{
+		size_t payload = i % (num_raw + num_elf);
+		bool raw = payload < num_raw;
+		char location[64];
+		if (raw)
+			snprintf(location, sizeof(location), "\"SD:/corpus/raw_%zu.bin\"", payload);
+		else
+			snprintf(location, sizeof(location), "\"SD:/corpus/elf_%zu.elf\"", payload - num_raw);
+
+		fprintf(file, "{\"name\":\"p%zu\",\"location\":", i);
+		if (i % 10 == 9)
+			fprintf(file, "[\"/missing/p%zu.bin\",%s]", i, location);
+		else
+			fprintf(file, "%s", location);
+
+		if (raw && raw_offsets[payload % ARRAY_SIZE(raw_offsets)])
+			fprintf(file, ",\"offset\":0x%" PRIX32, raw_offsets[payload % ARRAY_SIZE(raw_offsets)]);
+
+		if (i % 50 == 49)
+			fprintf(file, ",\"loads\":[{\"location\":\"SD:/corpus/raw_0.bin\",\"address\":0x%08" PRIX32 "}]",
+				0x20400000u + (uint32_t)(i % 16u) * 0x10000u);
+
+		//The last entry is always the "None" one, so selecting it scans the
+		//whole configuration
+		if (i == entries - 1)
+		{
+			fprintf(file, ",\"buttons\":[\"None\"]}\n");
+		}
+		else
+		{
+			const char *first = button_names[rng_next() % ARRAY_SIZE(button_names)];
+			const char *second = button_names[rng_next() % ARRAY_SIZE(button_names)];
+			if (rng_next() % 2u)
+				fprintf(file, ",\"buttons\":[\"%s\",\"%s\"]},\n", first, second);
+			else
+				fprintf(file, ",\"buttons\":[\"%s\"]},\n", first);
+		}
+	}
+	fprintf(file, "]}\n");
+
+	bool ok = !ferror(file);
+	return !fclose(file) && ok;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-s SEED] [-r RAW_PAYLOADS] [-e ELF_PAYLOADS] DIR\n"
+		"  -s  random seed (1)\n"
+		"  -r  number of raw payloads to generate (8)\n"
+		"  -e  number of ELF payloads to generate (8)\n",
+		name);
+}
+
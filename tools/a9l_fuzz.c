@@ -0,0 +1,736 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host side mutation fuzzer for the code that sees untrusted data first: the
+//configuration parser (a9l_config_read_json), and the ELF checks done before
+//anything is loaded (load_header, check_elf and queue_segments). It builds the
+//real src/ files against the stand-ins in tools/host/.
+//
+//Before fuzzing the configuration parser, a few built in inputs known to have
+//been slow are run under the same budgets. Inputs are then mutated from built
+//in seeds and any seed files given. A run fails
+//if the code crashes, breaks one of the limits it promises to enforce, takes
+//longer than the per input time budget, or the process's peak memory use goes
+//past the memory budget. The failing input is written out, and can be run on
+//its own again with -r.
+//
+//  a9l_fuzz [-t seconds] [-p milliseconds] [-m MiB] [-n runs] [-S seed]
+//      [-o crash_file] config|elf [seed files...]
+//  a9l_fuzz -r input config|elf
+//
+//Build with (add -fsanitize=address,undefined to CFLAGS to catch more):
+//  make -C tools a9l_fuzz
+//
+//Built with A9L_LIBFUZZER defined to a target's index (0 for config, 1 for elf)
+//this is a libFuzzer target instead, using the same checks, seeds and
+//mutations, see a9l_libfuzzer_config and a9l_libfuzzer_elf in tools/Makefile.
+
+#include "a9l_config.h"
+#include "load_list.h"
+#include "elf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define ARRAY_SIZE(X) (sizeof(X)/sizeof(*X))
+
+//Large enough to go past the configuration size limit
+#define MAX_INPUT (A9L_CONFIG_MAX_SIZE + 4096u)
+#define MAX_POOL 256u
+#define MAX_MUTATIONS 8u
+//Parsing stays linear, so even the largest regression input takes a
+//millisecond or so; a quadratic parse takes around a hundred
+#define REGRESSION_BUDGET 0.01
+
+typedef struct
+{
+	unsigned char *data;
+	size_t size;
+} fuzz_input;
+
+typedef struct
+{
+	const char *name;
+	//Returns false if the input broke one of the target's promises
+	bool (*run)(const unsigned char *data, size_t size, bool *accepted);
+	const char * const *dictionary;
+	size_t dictionary_size;
+} fuzz_target;
+
+static const char *config_dictionary[] = {
+	"{", "}", "[", "]", ":", ",", "\"", "\\", "\\u00", "0x", "-1", "0", " ",
+	"18446744073709551616", "\"\"",
+	"\"configuration\"", "\"name\"", "\"location\"", "\"offset\"", "\"buttons\"",
+	"\"loads\"", "\"patch\"", "\"address\"", "\"None\"", "\"A\"", "\"Select\"",
+	"\"Y\"", "\"Z\"", "\"SD:/a.bin\"", "\"CTRNAND:/a.bin\"", "\"a.bin\""
+};
+
+static const char seed_config[] =
+	"{ \"configuration\" : [\n"
+	"  { \"name\" : \"Cakes\", \"location\" : \"SD:/cakes/Cakes.dat\", \"offset\" : 0x12000, \"buttons\" : [\"None\"] },\n"
+	"  { \"name\" : \"GM9\", \"location\" : [\"SD:/gm9.bin\", \"CTRNAND:/gm9.bin\", \"gm9.bin\"], \"buttons\" : [\"Y\", \"R\"] },\n"
+	"  { \"name\" : \"Linux\", \"location\" : \"SD:/linux/arm9.bin\", \"buttons\" : [\"Start\"], \"patch\" : \"SD:/linux/fix.ips\",\n"
+	"    \"loads\" : [ { \"location\" : \"SD:/linux/zImage\", \"address\" : 0x20008000 },\n"
+	"                { \"location\" : \"SD:/linux/dtb\", \"offset\" : 16, \"address\" : 0x20000000 } ] }\n"
+	"] }\n";
+
+static const uint32_t interesting_words[] = {
+	0, 1, 2, 0x7F, 0x80, 0xFF, 0x100, 0x7FFF, 0x8000, 0xFFFF, 32, 33, 52,
+	0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, 0xFFFFFFE0
+};
+
+static uint64_t rng_state;
+
+static bool run_config(const unsigned char *data, size_t size, bool *accepted);
+static bool run_elf(const unsigned char *data, size_t size, bool *accepted);
+static bool check_config(const a9l_config *config);
+static size_t make_elf(unsigned char *buffer);
+static void put_le16(unsigned char *buffer, uint16_t value);
+static void put_le32(unsigned char *buffer, uint32_t value);
+static uint32_t rng_next(void);
+static size_t rng_below(size_t limit);
+static void mutate(fuzz_input *input, size_t capacity, const fuzz_input pool[], size_t pool_size,
+	const fuzz_target *target);
+
+#ifndef A9L_LIBFUZZER
+static const char *crash_path = "a9l_fuzz-crash.bin";
+static volatile const unsigned char *current_data;
+static volatile size_t current_size;
+
+static const char *run_regressions(const fuzz_target *target, double input_budget);
+static size_t make_flat_config(unsigned char *buffer, size_t arrays);
+static bool read_file(const char *path, fuzz_input *input);
+static bool write_crash(const unsigned char *data, size_t size);
+static void on_signal(int signal_number);
+static double now(void);
+static long peak_memory_kib(void);
+static void usage(const char *name);
+#endif
+
+#ifdef __SANITIZE_ADDRESS__
+//AddressSanitizer holds on to up to 256 MiB of freed memory by default, which
+//would count against the memory budget
+const char *__asan_default_options(void);
+const char *__asan_default_options(void)
+{
+	return "quarantine_size_mb=16";
+}
+#endif
+
+static const fuzz_target targets[] = {
+	{ "config", run_config, config_dictionary, ARRAY_SIZE(config_dictionary) },
+	{ "elf", run_elf, NULL, 0 }
+};
+
+#ifdef A9L_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+size_t LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size, unsigned int seed);
+
+//libFuzzer takes care of the time and memory budgets and writes out failing
+//inputs; a broken promise is reported to it as a crash
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	bool accepted = false;
+	if (!targets[A9L_LIBFUZZER].run(data, size, &accepted))
+		abort();
+	return 0;
+}
+
+//The driver's mutations, which know about the configuration's tokens and the
+//ELF's fields. libFuzzer starts from an empty input without a corpus, which
+//gets replaced by the built in seed.
+size_t LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size, unsigned int seed)
+{
+	const fuzz_target *target = &targets[A9L_LIBFUZZER];
+	rng_state = seed * 2654435761u + 1u;
+	fuzz_input input = { data, size };
+	if (!size)
+	{
+		static unsigned char buffer[MAX_INPUT];
+		if (target->run == run_config)
+		{
+			memcpy(buffer, seed_config, sizeof(seed_config) - 1);
+			input.size = sizeof(seed_config) - 1;
+		}
+		else
+		{
+			input.size = make_elf(buffer);
+		}
+		if (input.size > max_size)
+			input.size = max_size;
+		memcpy(data, buffer, input.size);
+		return input.size;
+	}
+
+	mutate(&input, max_size, &input, 1, target);
+	return input.size;
+}
+
+#else
+int main(int argc, char *argv[])
+{
+	double total_budget = 60.0;
+	double input_budget = 0.1;
+	long memory_budget = 256;
+	unsigned long long max_runs = 0;
+	unsigned long seed = (unsigned long)time(NULL);
+	const char *replay = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:p:m:n:S:o:r:")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				total_budget = strtod(optarg, NULL);
+				break;
+			case 'p':
+				input_budget = strtod(optarg, NULL) / 1000.0;
+				break;
+			case 'm':
+				memory_budget = strtol(optarg, NULL, 0);
+				break;
+			case 'n':
+				max_runs = strtoull(optarg, NULL, 0);
+				break;
+			case 'S':
+				seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'o':
+				crash_path = optarg;
+				break;
+			case 'r':
+				replay = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind >= argc || total_budget <= 0 || input_budget <= 0 || memory_budget <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const fuzz_target *target = NULL;
+	for (size_t i = 0; i < ARRAY_SIZE(targets); ++i)
+	{
+		if (strcmp(argv[optind], targets[i].name) == 0)
+			target = &targets[i];
+	}
+	if (!target)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (replay)
+	{
+		fuzz_input input;
+		if (!read_file(replay, &input))
+		{
+			fprintf(stderr, "Unable to read %s\n", replay);
+			return 1;
+		}
+		bool accepted = false;
+		bool res = target->run(input.data, input.size, &accepted);
+		printf("%s: %s, %s\n", replay, res ? "ok" : "FAILED", accepted ? "accepted" : "rejected");
+		free(input.data);
+		return res ? 0 : 1;
+	}
+
+	static fuzz_input pool[MAX_POOL];
+	size_t pool_size = 0;
+	if (target->run == run_config)
+	{
+		pool[0].size = sizeof(seed_config) - 1;
+		pool[0].data = malloc(MAX_INPUT);
+		memcpy(pool[0].data, seed_config, pool[0].size);
+	}
+	else
+	{
+		pool[0].data = malloc(MAX_INPUT);
+		pool[0].size = make_elf(pool[0].data);
+	}
+	pool_size++;
+
+	for (int i = optind + 1; i < argc && pool_size < MAX_POOL; ++i)
+	{
+		if (!read_file(argv[i], &pool[pool_size]))
+		{
+			fprintf(stderr, "Unable to read %s\n", argv[i]);
+			return 1;
+		}
+		pool_size++;
+	}
+
+	signal(SIGALRM, on_signal);
+	signal(SIGSEGV, on_signal);
+	signal(SIGBUS, on_signal);
+	signal(SIGFPE, on_signal);
+	signal(SIGABRT, on_signal);
+
+	//A hung input is stopped well past the budget, slow ones are caught below
+	struct itimerval hang = { { 0, 0 }, { 0, 0 } };
+	double hang_seconds = input_budget * 10.0 < 1.0 ? 1.0 : input_budget * 10.0;
+	hang.it_value.tv_sec = (time_t)hang_seconds;
+	hang.it_value.tv_usec = (suseconds_t)((hang_seconds - (double)hang.it_value.tv_sec) * 1e6);
+
+	printf("a9l_fuzz %s: seed %lu, %.0f s, %.0f ms per input, %ld MiB\n",
+		target->name, seed, total_budget, input_budget * 1000.0, memory_budget);
+	rng_state = seed * 2654435761u + 1u;
+
+	fuzz_input input = { malloc(MAX_INPUT), 0 };
+	double start = now();
+	double slowest = 0;
+	size_t largest = 0;
+	unsigned long long runs = 0, accepted_runs = 0;
+	const char *failure = target->run == run_config ? run_regressions(target, input_budget) : NULL;
+	//run_regressions writes out its own failing input
+	bool regressed = failure != NULL;
+
+	while (!failure && now() - start < total_budget && (!max_runs || runs < max_runs))
+	{
+		const fuzz_input *parent = &pool[rng_below(pool_size)];
+		memcpy(input.data, parent->data, parent->size);
+		input.size = parent->size;
+		mutate(&input, MAX_INPUT, pool, pool_size, target);
+
+		current_data = input.data;
+		current_size = input.size;
+		setitimer(ITIMER_REAL, &hang, NULL);
+		double input_start = now();
+		bool accepted = false;
+		bool res = target->run(input.data, input.size, &accepted);
+		double elapsed = now() - input_start;
+		struct itimerval off = { { 0, 0 }, { 0, 0 } };
+		setitimer(ITIMER_REAL, &off, NULL);
+		runs++;
+
+		if (elapsed > slowest)
+			slowest = elapsed;
+		if (input.size > largest)
+			largest = input.size;
+
+		if (!res)
+			failure = "a limit was not enforced";
+		else if (elapsed > input_budget)
+			failure = "the time budget was exceeded";
+		else if (peak_memory_kib() > memory_budget * 1024)
+			failure = "the memory budget was exceeded";
+
+		//Inputs that get past validation reach the most code, keep them around
+		if (accepted)
+		{
+			accepted_runs++;
+			fuzz_input *slot = pool_size < MAX_POOL ? &pool[pool_size++] : &pool[1 + rng_below(MAX_POOL - 1)];
+			if (!slot->data)
+				slot->data = malloc(MAX_INPUT);
+			memcpy(slot->data, input.data, input.size);
+			slot->size = input.size;
+		}
+	}
+
+	printf("%llu runs, %llu accepted, pool of %zu, largest input %zu bytes, slowest %.3f ms, peak memory %ld KiB\n",
+		runs, accepted_runs, pool_size, largest, slowest * 1000.0, peak_memory_kib());
+
+	if (failure)
+	{
+		bool written = regressed || write_crash(input.data, input.size);
+		printf("FAILED: %s, input %s %s\n", failure, written ? "written to" : "could not be written to", crash_path);
+	}
+
+	for (size_t i = 0; i < pool_size; ++i)
+	{
+		free(pool[i].data);
+	}
+	free(input.data);
+	return failure ? 1 : 0;
+}
+#endif
+
+//Helper functions follow
+
+static bool run_config(const unsigned char *data, size_t size, bool *accepted)
+{
+	char *json = malloc(size + 1);
+	if (!json)
+		return false;
+	memcpy(json, data, size);
+	json[size] = '\0';
+
+	a9l_config config = { NULL, 0 };
+	bool res = true;
+	*accepted = a9l_config_read_json(&config, json);
+	if (*accepted)
+	{
+		res = check_config(&config);
+		a9l_config_destroy(&config);
+	}
+	free(json);
+	return res;
+}
+
+static bool check_config(const a9l_config *config)
+{
+	if (a9l_config_get_number_of_entries(config) > A9L_CONFIG_MAX_ENTRIES)
+		return false;
+
+	for (size_t i = 0; i < a9l_config_get_number_of_entries(config); ++i)
+	{
+		const a9l_config_entry *entry = a9l_config_get_entry(config, i);
+		if (!entry->num_payloads || entry->num_payloads > A9L_CONFIG_MAX_LOCATIONS)
+			return false;
+		for (size_t j = 0; j < entry->num_payloads; ++j)
+		{
+			if (strlen(entry->payloads[j]) > A9L_CONFIG_MAX_STRING)
+				return false;
+		}
+
+		if (entry->num_loads > A9L_CONFIG_MAX_LOADS || (entry->num_loads && !entry->loads))
+			return false;
+		for (size_t j = 0; j < entry->num_loads; ++j)
+		{
+			if (!entry->loads[j].location || strlen(entry->loads[j].location) > A9L_CONFIG_MAX_STRING)
+				return false;
+		}
+
+		if (entry->patch && strlen(entry->patch) > A9L_CONFIG_MAX_STRING)
+			return false;
+	}
+	return true;
+}
+
+static bool run_elf(const unsigned char *data, size_t size, bool *accepted)
+{
+	//fmemopen can't open empty buffers
+	if (!size)
+		return true;
+
+	FILE *file = fmemopen((void*)data, size, "rb");
+	if (!file)
+		return false;
+
+	Elf32_Ehdr header;
+	load_header(&header, file);
+	*accepted = check_elf(&header);
+
+	bool res = true;
+	if (*accepted)
+	{
+		//Entries can already have queued loads, so start partway full too
+		const char *path = "SD:/payload.elf";
+		size_t queued = data[size - 1] % 24u;
+		load_list list;
+		load_list_initialize(&list);
+		for (size_t i = 0; i < queued; ++i)
+		{
+			load_list_add(&list, "SD:/load.bin", 0, (void*)(0x20000000u + i * 0x1000u), 0x100, 0);
+		}
+
+		int queue_res = queue_segments(&header, file, path, &list);
+		res = list.count <= LOAD_LIST_MAX_ITEMS &&
+			list.count <= queued + header.e_phnum &&
+			(queue_res || header.e_phnum <= ELF_MAX_PROGRAM_HEADERS);
+		for (size_t i = queued; i < list.count && res; ++i)
+		{
+			res = list.items[i].path == path;
+		}
+	}
+
+	fclose(file);
+	return res;
+}
+
+static size_t make_elf(unsigned char *buffer)
+{
+	//Three PT_LOAD segments, one with a .bss tail, and a PT_NOTE to skip
+	const uint32_t types[] = { 1, 1, 4, 1 };
+	const size_t num_headers = ARRAY_SIZE(types);
+	const uint32_t data_offset = 52u + 32u * num_headers;
+
+	memset(buffer, 0, data_offset + 4u * 256u);
+	memcpy(buffer, "\x7F" "ELF", 4);
+	buffer[4] = 1;
+	buffer[5] = 1;
+	buffer[6] = 1;
+	put_le16(buffer + 16, 2);
+	put_le16(buffer + 18, 40);
+	put_le32(buffer + 20, 1);
+	put_le32(buffer + 24, 0x20000000u);
+	put_le32(buffer + 28, 52);
+	put_le16(buffer + 40, 52);
+	put_le16(buffer + 42, 32);
+	put_le16(buffer + 44, (uint16_t)num_headers);
+
+	for (size_t i = 0; i < num_headers; ++i)
+	{
+		unsigned char *header = buffer + 52u + 32u * i;
+		put_le32(header, types[i]);
+		put_le32(header + 4, data_offset + (uint32_t)i * 256u);
+		put_le32(header + 8, 0x20000000u + (uint32_t)i * 0x10000u);
+		put_le32(header + 12, 0x20000000u + (uint32_t)i * 0x10000u);
+		put_le32(header + 16, 256);
+		put_le32(header + 20, i == 1 ? 4096 : 256);
+		put_le32(header + 24, 7);
+		put_le32(header + 28, 4);
+	}
+	return data_offset + 4u * 256u;
+}
+
+static void put_le16(unsigned char *buffer, uint16_t value)
+{
+	buffer[0] = (unsigned char)value;
+	buffer[1] = (unsigned char)(value >> 8);
+}
+
+static void put_le32(unsigned char *buffer, uint32_t value)
+{
+	put_le16(buffer, (uint16_t)value);
+	put_le16(buffer + 2, (uint16_t)(value >> 16));
+}
+
+static uint32_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (uint32_t)(rng_state >> 32);
+}
+
+static size_t rng_below(size_t limit)
+{
+	return limit ? rng_next() % limit : 0;
+}
+
+static void mutate(fuzz_input *input, size_t capacity, const fuzz_input pool[], size_t pool_size,
+	const fuzz_target *target)
+{
+	size_t count = 1 + rng_below(MAX_MUTATIONS);
+	for (size_t m = 0; m < count; ++m)
+	{
+		size_t position = rng_below(input->size + 1);
+		switch (rng_below(9))
+		{
+			case 0: //Flip a bit
+				if (input->size)
+					input->data[rng_below(input->size)] ^= (unsigned char)(1u << rng_below(8));
+				break;
+			case 1: //Random byte
+				if (input->size)
+					input->data[rng_below(input->size)] = (unsigned char)rng_next();
+				break;
+			case 2: //Interesting word, aligned so ELF fields are hit
+			{
+				uint32_t word = interesting_words[rng_below(ARRAY_SIZE(interesting_words))];
+				size_t width = rng_below(2) ? 4 : 2;
+				position &= ~(width - 1);
+				if (position + width <= input->size)
+				{
+					if (width == 4)
+						put_le32(input->data + position, word);
+					else
+						put_le16(input->data + position, (uint16_t)word);
+				}
+				break;
+			}
+			case 3: //Insert a token
+				if (target->dictionary_size)
+				{
+					const char *token = target->dictionary[rng_below(target->dictionary_size)];
+					size_t length = strlen(token);
+					if (input->size + length <= capacity)
+					{
+						memmove(input->data + position + length, input->data + position, input->size - position);
+						memcpy(input->data + position, token, length);
+						input->size += length;
+					}
+				}
+				break;
+			case 4: //Delete a range
+			{
+				size_t length = rng_below(input->size - position + 1);
+				if (length > 64 && rng_below(4))
+					length = rng_below(64);
+				memmove(input->data + position, input->data + position + length, input->size - position - length);
+				input->size -= length;
+				break;
+			}
+			case 5: //Duplicate a range
+			{
+				size_t length = rng_below(input->size - position + 1);
+				if (length > 256)
+					length = rng_below(256);
+				if (input->size + length <= capacity)
+				{
+					memmove(input->data + position + length, input->data + position, input->size - position);
+					input->size += length;
+				}
+				break;
+			}
+			case 6: //Splice in part of another input
+			{
+				const fuzz_input *other = &pool[rng_below(pool_size)];
+				size_t from = rng_below(other->size + 1);
+				size_t length = rng_below(other->size - from + 1);
+				if (position + length <= capacity)
+				{
+					memmove(input->data + position, other->data + from, length);
+					if (position + length > input->size)
+						input->size = position + length;
+				}
+				break;
+			}
+			case 7: //Repeat a short range, to reach the size limits in a few steps
+			{
+				size_t length = 1 + rng_below(input->size - position < 16 ? input->size - position : 16);
+				size_t times = 1 + rng_below(4096);
+				if (position == input->size || input->size + length * times > capacity)
+					break;
+				memmove(input->data + position + length * times, input->data + position, input->size - position);
+				for (size_t i = 1; i < times; ++i)
+					memcpy(input->data + position + length * i, input->data + position, length);
+				input->size += length * times;
+				break;
+			}
+			default: //Truncate
+				input->size = position;
+				break;
+		}
+	}
+}
+
+#ifndef A9L_LIBFUZZER
+//Inputs that used to take seconds or more to parse: jsmn without parent links
+//scans back over every closed token at each closing bracket
+static const char *run_regressions(const fuzz_target *target, double input_budget)
+{
+	//Flat arrays of empty arrays, as many as used to fit in the limits, and as
+	//many as fit in the current token limit
+	const size_t arrays[] = { 130000u, A9L_CONFIG_MAX_TOKENS - 3u };
+	double budget = input_budget < REGRESSION_BUDGET ? input_budget : REGRESSION_BUDGET;
+	const char *failure = NULL;
+	for (size_t i = 0; i < ARRAY_SIZE(arrays) && !failure; ++i)
+	{
+		unsigned char *buffer = malloc(arrays[i] * 3u + 32u);
+		if (!buffer)
+			return "a regression input could not be allocated";
+		size_t size = make_flat_config(buffer, arrays[i]);
+
+		current_data = buffer;
+		current_size = size;
+		double start = now();
+		bool accepted = false;
+		bool res = target->run(buffer, size, &accepted);
+		double elapsed = now() - start;
+		printf("regression: %zu empty arrays, %zu bytes, %s in %.3f ms\n", arrays[i], size,
+			accepted ? "accepted" : "rejected", elapsed * 1000.0);
+
+		if (!res)
+			failure = "a limit was not enforced on a regression input";
+		else if (elapsed > budget)
+			failure = "the time budget was exceeded on a regression input";
+		if (failure && !write_crash(buffer, size))
+			failure = "a regression input failed, and could not be written out";
+		free(buffer);
+	}
+	return failure;
+}
+
+//{"configuration":[[],[],...]}
+static size_t make_flat_config(unsigned char *buffer, size_t arrays)
+{
+	static const char head[] = "{\"configuration\":[";
+	size_t size = sizeof(head) - 1;
+	memcpy(buffer, head, size);
+	for (size_t i = 0; i < arrays; ++i)
+	{
+		memcpy(buffer + size, i ? ",[]" : "[]", i ? 3 : 2);
+		size += i ? 3 : 2;
+	}
+	memcpy(buffer + size, "]}", 2);
+	return size + 2;
+}
+
+static bool read_file(const char *path, fuzz_input *input)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	input->data = malloc(MAX_INPUT);
+	input->size = input->data ? fread(input->data, 1, MAX_INPUT, file) : 0;
+	fclose(file);
+	return input->data != NULL;
+}
+
+static bool write_crash(const unsigned char *data, size_t size)
+{
+	FILE *file = fopen(crash_path, "wb");
+	if (!file)
+		return false;
+	bool res = size == fwrite(data, 1, size, file);
+	return fclose(file) == 0 && res;
+}
+
+static void on_signal(int signal_number)
+{
+	//Only async signal safe calls from here on
+	static const char message[] = "a9l_fuzz: input crashed or hung, writing it out\n";
+	ssize_t res = write(STDERR_FILENO, message, sizeof(message) - 1);
+	int file = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file >= 0)
+	{
+		res = write(file, (const void*)current_data, current_size);
+		close(file);
+	}
+	(void)res;
+	signal(signal_number, SIG_DFL);
+	raise(signal_number);
+}
+
+static double now(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static long peak_memory_kib(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-t seconds] [-p milliseconds] [-m MiB] [-n runs] [-S seed]\n"
+		"           [-o crash_file] config|elf [seed files...]\n"
+		"       %s -r input config|elf\n"
+		"  -t  total time budget, default 60 seconds\n"
+		"  -p  time budget per input, default 100 ms\n"
+		"  -m  peak memory budget, default 256 MiB\n"
+		"  -n  stop after this many inputs\n"
+		"  -S  random seed, for reproducing a run\n"
+		"  -o  where to write a failing input, default a9l_fuzz-crash.bin\n"
+		"  -r  run a single input, e.g. a written out failure\n",
+		name, name);
+}
+#endif
@@ -0,0 +1,437 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host side replayer for traces recorded with --enable-trace. Re-runs the
+//recorded operations against drive images (directories holding the contents
+//of each drive) and reports the bytes moved, seeks and modelled latency for a
+//given I/O strategy, so changes to the boot path can be compared on the same
+//recorded boots.
+//
+//Build with:
+//  make -C tools a9l_replay
+
+#include "a9l_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#define ARRAY_SIZE(X) (sizeof(X)/sizeof(*X))
+
+typedef enum
+{
+	STRATEGY_RECORDED,
+	STRATEGY_CHUNKED,
+	STRATEGY_BUFFERED
+} strategy_type;
+
+typedef struct
+{
+	strategy_type type;
+	size_t size;
+
+	double request_latency; //microseconds per device request
+	double seek_latency; //microseconds per non-sequential request
+	double bandwidth; //bytes per microsecond
+} strategy;
+
+typedef struct
+{
+	uint64_t requests;
+	uint64_t bytes;
+	uint64_t seeks;
+	uint64_t stats;
+	uint64_t writes;
+	uint64_t bytes_written;
+	uint64_t failures;
+	uint64_t selection_hits;
+	uint64_t selection_misses;
+	uint64_t prefetch_hits;
+	uint64_t prefetch_misses;
+	double latency;
+} replay_result;
+
+typedef struct
+{
+	const char *drive;
+	const char *directory;
+} drive_image;
+
+typedef struct
+{
+	FILE *file;
+	uint16_t path;
+	uint64_t device_position; //where the device head was left
+	uint64_t buffer_start; //for STRATEGY_BUFFERED
+	uint64_t buffer_end;
+} replay_file;
+
+static drive_image images[8];
+static size_t num_images;
+
+static const char *drive_names[] = { "SD:", "CTRNAND:", "TWLN:", "TWLP:" };
+
+static bool resolve_path(char *out, size_t out_size, const char *path, const char *current_drive);
+static void device_request(replay_result *result, const strategy *strat, replay_file *file, uint64_t offset, uint64_t size);
+static void replay_read(replay_result *result, const strategy *strat, replay_file *file, uint64_t offset, uint64_t size);
+static bool parse_strategy(strategy *strat, const char *text);
+static void usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+	strategy strat = { STRATEGY_RECORDED, 0, 250.0, 1000.0, 10.0 };
+	int opt;
+	while ((opt = getopt(argc, argv, "d:s:l:k:b:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+			{
+				char *split = strchr(optarg, '=');
+				if (!split || num_images >= ARRAY_SIZE(images))
+				{
+					usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				*split = '\0';
+				images[num_images].drive = optarg;
+				images[num_images].directory = split + 1;
+				num_images++;
+				break;
+			}
+			case 's':
+				if (!parse_strategy(&strat, optarg))
+				{
+					usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'l':
+				strat.request_latency = strtod(optarg, NULL);
+				break;
+			case 'k':
+				strat.seek_latency = strtod(optarg, NULL);
+				break;
+			case 'b':
+				strat.bandwidth = strtod(optarg, NULL);
+				break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1 || strat.bandwidth <= 0.0)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE *trace = fopen(argv[optind], "rb");
+	if (!trace)
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	a9l_trace_header header;
+	if (fread(&header, sizeof(header), 1, trace) != 1 ||
+		header.magic != A9L_TRACE_MAGIC ||
+		header.version != A9L_TRACE_VERSION ||
+		header.num_paths > A9L_TRACE_MAX_PATHS)
+	{
+		fprintf(stderr, "%s: not a valid trace file\n", argv[optind]);
+		fclose(trace);
+		return EXIT_FAILURE;
+	}
+
+	char paths[A9L_TRACE_MAX_PATHS][A9L_TRACE_PATH_SIZE] = { { 0 } };
+	if (header.num_paths &&
+		fread(paths, A9L_TRACE_PATH_SIZE, header.num_paths, trace) != header.num_paths)
+	{
+		fprintf(stderr, "%s: truncated path table\n", argv[optind]);
+		fclose(trace);
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < header.num_paths; ++i)
+		paths[i][A9L_TRACE_PATH_SIZE - 1] = '\0';
+
+	replay_result result = { 0 };
+	replay_file files[8] = { { 0 } };
+	const char *current_drive = "SD:";
+	uint32_t first_timestamp = 0, last_timestamp = 0;
+
+	for (uint32_t i = 0; i < header.num_records; ++i)
+	{
+		a9l_trace_record rec;
+		if (fread(&rec, sizeof(rec), 1, trace) != 1)
+		{
+			fprintf(stderr, "%s: truncated after %" PRIu32 " records\n", argv[optind], i);
+			break;
+		}
+		if (i == 0)
+			first_timestamp = rec.timestamp;
+		last_timestamp = rec.timestamp;
+
+		const char *path = rec.path < header.num_paths ? paths[rec.path] : NULL;
+		replay_file *file = NULL;
+		for (size_t j = 0; j < ARRAY_SIZE(files) && path; ++j)
+		{
+			if (files[j].file && files[j].path == rec.path)
+				file = &files[j];
+		}
+
+		char resolved[1024];
+		switch ((a9l_trace_operation)rec.operation)
+		{
+			case A9L_TRACE_OPEN:
+				if (rec.failed || !path || !resolve_path(resolved, sizeof(resolved), path, current_drive))
+					break;
+				for (size_t j = 0; j < ARRAY_SIZE(files); ++j)
+				{
+					if (!files[j].file)
+					{
+						files[j].file = fopen(resolved, "rb");
+						files[j].path = rec.path;
+						files[j].device_position = UINT64_MAX;
+						files[j].buffer_start = files[j].buffer_end = 0;
+						if (!files[j].file)
+						{
+							fprintf(stderr, "warning: unable to open %s\n", resolved);
+							result.failures++;
+						}
+						break;
+					}
+				}
+				break;
+			case A9L_TRACE_CLOSE:
+				if (file)
+				{
+					fclose(file->file);
+					file->file = NULL;
+				}
+				break;
+			case A9L_TRACE_READ:
+				if (file)
+					replay_read(&result, &strat, file, rec.offset, rec.size);
+				break;
+			case A9L_TRACE_STAT:
+			{
+				struct stat st;
+				result.stats++;
+				result.latency += strat.request_latency;
+				bool exists = path && resolve_path(resolved, sizeof(resolved), path, current_drive) &&
+					stat(resolved, &st) == 0;
+				if (exists == (bool)rec.failed)
+					result.failures++;
+				break;
+			}
+			case A9L_TRACE_CHDRIVE:
+				for (size_t j = 0; j < ARRAY_SIZE(drive_names) && path; ++j)
+				{
+					if (strcmp(drive_names[j], path) == 0)
+						current_drive = drive_names[j];
+				}
+				break;
+			case A9L_TRACE_WRITE:
+				//Nothing is written during replay, only the cost is modelled
+				result.writes++;
+				result.bytes_written += rec.size;
+				result.latency += strat.request_latency + strat.seek_latency + (double)rec.size / strat.bandwidth;
+				break;
+			case A9L_TRACE_SELECTION:
+				if (rec.failed)
+					result.selection_misses++;
+				else
+					result.selection_hits++;
+				break;
+			case A9L_TRACE_PREFETCH:
+				if (rec.failed)
+					result.prefetch_misses++;
+				else
+					result.prefetch_hits++;
+				break;
+			case A9L_TRACE_SEEK:
+			case A9L_TRACE_READY:
+				//Seeks are accounted for when the next read happens
+				break;
+			default:
+				fprintf(stderr, "warning: unknown operation %u\n", rec.operation);
+				break;
+		}
+	}
+
+	for (size_t j = 0; j < ARRAY_SIZE(files); ++j)
+	{
+		if (files[j].file)
+			fclose(files[j].file);
+	}
+	fclose(trace);
+
+	printf("records: %" PRIu32 "\n", header.num_records);
+	printf("recorded time: %.3f ms\n", header.frequency ?
+		(double)(uint32_t)(last_timestamp - first_timestamp) * 1000.0 / header.frequency : 0.0);
+	printf("requests: %" PRIu64 "\n", result.requests);
+	printf("bytes: %" PRIu64 "\n", result.bytes);
+	printf("seeks: %" PRIu64 "\n", result.seeks);
+	printf("stats: %" PRIu64 "\n", result.stats);
+	printf("writes: %" PRIu64 "\n", result.writes);
+	printf("bytes written: %" PRIu64 "\n", result.bytes_written);
+	printf("remembered selection hits: %" PRIu64 "\n", result.selection_hits);
+	printf("remembered selection misses: %" PRIu64 "\n", result.selection_misses);
+	printf("prefetch hits: %" PRIu64 "\n", result.prefetch_hits);
+	printf("prefetch misses: %" PRIu64 "\n", result.prefetch_misses);
+	printf("mismatches: %" PRIu64 "\n", result.failures);
+	printf("modelled latency: %.3f ms\n", result.latency / 1000.0);
+
+	return result.failures ? 2 : EXIT_SUCCESS;
+}
+
+//Helper functions follow
+
+static bool resolve_path(char *out, size_t out_size, const char *path, const char *current_drive)
+{
+	const char *drive = current_drive;
+	const char *rest = path;
+	const char *colon = strchr(path, ':');
+	size_t drive_length = strlen(current_drive);
+	if (colon)
+	{
+		drive = path;
+		drive_length = (size_t)(colon - path) + 1;
+		rest = colon + 1;
+	}
+
+	for (size_t i = 0; i < num_images; ++i)
+	{
+		if (strlen(images[i].drive) == drive_length &&
+			strncmp(images[i].drive, drive, drive_length) == 0)
+		{
+			int res = snprintf(out, out_size, "%s%s", images[i].directory, rest);
+			return res > 0 && (size_t)res < out_size;
+		}
+	}
+	return false;
+}
+
+static void device_request(replay_result *result, const strategy *strat, replay_file *file, uint64_t offset, uint64_t size)
+{
+	result->requests++;
+	result->latency += strat->request_latency + (double)size / strat->bandwidth;
+	if (file->device_position != offset)
+	{
+		result->seeks++;
+		result->latency += strat->seek_latency;
+	}
+	file->device_position = offset + size;
+}
+
+static void replay_read(replay_result *result, const strategy *strat, replay_file *file, uint64_t offset, uint64_t size)
+{
+	//Actually touch the data so missing or short images are caught
+	static char scratch[64 * 1024];
+	if (fseeko(file->file, (off_t)offset, SEEK_SET) == 0)
+	{
+		uint64_t left = size;
+		while (left)
+		{
+			size_t amount = left > sizeof(scratch) ? sizeof(scratch) : (size_t)left;
+			size_t got = fread(scratch, 1, amount, file->file);
+			if (got != amount)
+			{
+				result->failures++;
+				break;
+			}
+			left -= got;
+		}
+	}
+	else
+	{
+		result->failures++;
+	}
+
+	switch (strat->type)
+	{
+		case STRATEGY_RECORDED:
+			device_request(result, strat, file, offset, size);
+			result->bytes += size;
+			break;
+		case STRATEGY_CHUNKED:
+			for (uint64_t done = 0; done < size; done += strat->size)
+			{
+				uint64_t amount = size - done > strat->size ? strat->size : size - done;
+				device_request(result, strat, file, offset + done, amount);
+				result->bytes += amount;
+			}
+			break;
+		case STRATEGY_BUFFERED:
+		{
+			//Model a read-ahead buffer of the given size, like stdio's
+			uint64_t position = offset;
+			uint64_t end = offset + size;
+			while (position < end)
+			{
+				if (position >= file->buffer_start && position < file->buffer_end)
+				{
+					position = end < file->buffer_end ? end : file->buffer_end;
+					continue;
+				}
+				uint64_t start = position - position % strat->size;
+				device_request(result, strat, file, start, strat->size);
+				result->bytes += strat->size;
+				file->buffer_start = start;
+				file->buffer_end = start + strat->size;
+			}
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+static bool parse_strategy(strategy *strat, const char *text)
+{
+	if (strcmp(text, "recorded") == 0)
+	{
+		strat->type = STRATEGY_RECORDED;
+		return true;
+	}
+
+	const char *colon = strchr(text, ':');
+	if (!colon)
+		return false;
+
+	char *end = NULL;
+	unsigned long long size = strtoull(colon + 1, &end, 0);
+	if (*end != '\0' || size == 0)
+		return false;
+	strat->size = (size_t)size;
+
+	if (strncmp(text, "chunked:", 8) == 0)
+		strat->type = STRATEGY_CHUNKED;
+	else if (strncmp(text, "buffered:", 9) == 0)
+		strat->type = STRATEGY_BUFFERED;
+	else
+		return false;
+	return true;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-d DRIVE:=DIR]... [-s STRATEGY] [-l US] [-k US] [-b BYTES_PER_US] TRACE\n"
+		"  -d  map a drive (SD:, CTRNAND:, TWLN:, TWLP:) to a directory image\n"
+		"  -s  recorded (default), chunked:SIZE or buffered:SIZE\n"
+		"  -l  modelled latency per device request in microseconds (250)\n"
+		"  -k  modelled latency per seek in microseconds (1000)\n"
+		"  -b  modelled bandwidth in bytes per microsecond (10)\n",
+		name);
+}
+
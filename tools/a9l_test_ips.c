@@ -0,0 +1,475 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host test for patched loads. Builds src/ips.c and src/load_list.c against the
+//host layer, loads random base files with random IPS patches the way the
+//launcher does, as a raw payload from an offset or as ELF-like segments with
+//.bss, and compares what lands in memory with the base file patched offline
+//by a plain IPS patcher. Patches write past the end of the file, overlap each
+//other and loaded ranges, and use run length encoded records, and some are cut
+//short and must fail the load. A patch that grows a raw payload up to the next
+//load in memory must work, and one that grows it further must fail the load
+//without writing over it.
+//
+//It then times a large payload loaded with a small patch against the same
+//payload patched beforehand, both on a simulated SD card and on the host.
+//
+//Build and run with:
+//  make -C tools a9l_test_ips && ./tools/a9l_test_ips
+//  ./tools/a9l_test_ips -n 20000 -s 1234
+
+#include "load_list.h"
+#include "a9l_timer.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_BASE_SIZE 0x10000u
+#define MAX_RECORDS 32u
+#define MAX_RECORD_SIZE 600u
+#define MAX_RLE_SIZE 2000u
+//Records start at most this far past the end of the base file
+#define MAX_PAST_END 4096u
+#define MAX_GROWTH (MAX_PAST_END + MAX_RLE_SIZE)
+#define MAX_SEGMENTS 4u
+#define MAX_BSS 256u
+#define SENTINEL 0xCC
+#define SENTINEL_SIZE 64u
+
+//A growable byte buffer
+typedef struct
+{
+	unsigned char *data;
+	size_t size;
+} buffer;
+
+static char root[1024];
+static uint64_t state;
+
+static bool run_case(void);
+static void grow_into_load(void);
+static bool grow_case(size_t offset, size_t size, int fill, bool fits);
+static void time_loads(void);
+static double load_time(const char *payload, const char *patch, void *destination, size_t repeats, uint64_t *ticks);
+static void build_patch(buffer *patch, buffer *patched, size_t base_size);
+static void offline_patch(buffer *file, size_t offset, const unsigned char *data, size_t size, int fill);
+static void append(buffer *out, const void *data, size_t size);
+static void append_be(buffer *out, uint32_t value, size_t bytes);
+static bool untouched(const unsigned char *data, size_t size);
+static uint32_t next_random(void);
+static uint32_t random_below(uint32_t limit);
+static double now(void);
+
+int main(int argc, char *argv[])
+{
+	size_t cases = 2000;
+	uint64_t seed = (uint64_t)time(NULL);
+	int option;
+	while ((option = getopt(argc, argv, "n:s:")) != -1)
+	{
+		switch (option)
+		{
+			case 'n':
+				cases = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n cases] [-s seed]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if (!a9l_host_temp_directory(root, sizeof(root)))
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+	a9l_host_reset();
+	a9l_host_map_drive("SD:", root);
+
+	printf("%zu random patches, seed %llu\n", cases, (unsigned long long)seed);
+	state = seed ? seed : 1;
+	for (size_t i = 0; i < cases; ++i)
+	{
+		if (!run_case())
+		{
+			printf("  case %zu failed, rerun with -s %llu\n", i, (unsigned long long)seed);
+			a9l_host_fail();
+			break;
+		}
+	}
+
+	grow_into_load();
+	time_loads();
+
+	a9l_host_remove_directory(root);
+	return a9l_host_finish();
+}
+
+//Helper functions follow
+
+static bool run_case(void)
+{
+	size_t base_size = random_below(8) ? random_below(MAX_BASE_SIZE + 1) : random_below(64);
+	buffer base = { malloc(base_size + 1), base_size };
+	for (size_t i = 0; i < base_size; ++i)
+		base.data[i] = (unsigned char)next_random();
+
+	buffer patch = { NULL, 0 };
+	buffer patched = { malloc(base_size + 1), base_size };
+	memcpy(patched.data, base.data, base_size);
+	build_patch(&patch, &patched, base_size);
+
+	//Cut short anywhere before the end of the footer
+	bool truncated = random_below(10) == 0;
+	if (truncated)
+		patch.size = random_below((uint32_t)patch.size);
+
+	//Either a raw payload from an offset, or segments of the file with .bss
+	//and gaps in between
+	bool raw = random_below(2);
+	size_t count = raw ? 1 : 1 + random_below(MAX_SEGMENTS);
+	uint64_t offsets[MAX_SEGMENTS];
+	size_t sizes[MAX_SEGMENTS];
+	size_t zero_sizes[MAX_SEGMENTS];
+	size_t cuts[MAX_SEGMENTS * 2];
+	for (size_t i = 0; i < count * 2; ++i)
+		cuts[i] = random_below((uint32_t)base_size + 1);
+	for (size_t i = 1; i < count * 2; ++i)
+	{
+		for (size_t j = i; j > 0 && cuts[j - 1] > cuts[j]; --j)
+		{
+			size_t swap = cuts[j];
+			cuts[j] = cuts[j - 1];
+			cuts[j - 1] = swap;
+		}
+	}
+	for (size_t i = 0; i < count; ++i)
+	{
+		offsets[i] = cuts[i * 2];
+		sizes[i] = cuts[i * 2 + 1] - cuts[i * 2];
+		zero_sizes[i] = raw ? 0 : random_below(MAX_BSS + 1);
+	}
+	//The last segment may run to the end of the file
+	if (raw || random_below(2))
+		sizes[count - 1] = LOAD_TO_END;
+
+	size_t slot = base_size + MAX_BSS + MAX_GROWTH + SENTINEL_SIZE;
+	unsigned char *memory = malloc(slot * count);
+	memset(memory, SENTINEL, slot * count);
+
+	load_list list;
+	load_list_initialize(&list);
+	for (size_t i = 0; i < count; ++i)
+		load_list_add(&list, "SD:/base.bin", offsets[i], memory + slot * i, sizes[i], zero_sizes[i]);
+	load_list_set_patch(&list, "SD:/base.bin", "SD:/patch.ips");
+
+	bool ok = a9l_host_put("SD:/base.bin", base.data, base.size) &&
+		a9l_host_put("SD:/patch.ips", patch.data, patch.size);
+	int res = load_list_run(&list);
+	if (truncated)
+	{
+		ok = ok && res != 0;
+	}
+	else
+	{
+		ok = ok && res == 0;
+		for (size_t i = 0; i < count && ok; ++i)
+		{
+			const unsigned char *loaded = memory + slot * i;
+			//Only loads to the end of the file with nothing after them take
+			//what the patch appends
+			size_t size = sizes[i];
+			if (size == LOAD_TO_END)
+				size = (zero_sizes[i] ? base_size : patched.size) - (size_t)offsets[i];
+			ok = memcmp(loaded, patched.data + offsets[i], size) == 0 &&
+				untouched(loaded + size + zero_sizes[i], SENTINEL_SIZE);
+			for (size_t j = 0; j < zero_sizes[i] && ok; ++j)
+				ok = loaded[size + j] == 0;
+		}
+	}
+
+	if (!ok)
+		printf("  base %zu bytes, patch %zu bytes%s, %zu %s\n", base_size, patch.size,
+			truncated ? " (truncated)" : "", count, raw ? "raw load" : "segments");
+
+	free(memory);
+	free(base.data);
+	free(patch.data);
+	free(patched.data);
+	return ok;
+}
+
+//A raw payload with another file loaded right after it, as with an additional
+//load the entry lists, and patches that grow the payload up to and into it
+static void grow_into_load(void)
+{
+	printf("Patches growing a payload into the next load\n");
+	CHECK(grow_case(1000, 24, -1, true));
+	CHECK(grow_case(1000, 24, 0x5A, true));
+	CHECK(grow_case(1000, 25, -1, false));
+	CHECK(grow_case(1000, 25, 0x5A, false));
+	//Starting past the next load, with nothing written in between
+	CHECK(grow_case(1100, 16, -1, false));
+	CHECK(grow_case(1100, 16, 0x5A, false));
+	//Far past the end, where the gap would be zeroed first
+	CHECK(grow_case(0x10000, 1, 0x5A, false));
+}
+
+//The payload is 1000 bytes at the start of memory, and the other load 256
+//bytes at 1024. Applies one record of size bytes at offset, read from the
+//patch or run length encoded with fill, and checks the load only works if it
+//fits, and that the other load is left alone either way.
+static bool grow_case(size_t offset, size_t size, int fill, bool fits)
+{
+	const size_t base_size = 1000, other_offset = 1024, other_size = 256;
+	buffer base = { malloc(base_size), base_size };
+	buffer other = { malloc(other_size), other_size };
+	for (size_t i = 0; i < base_size; ++i)
+		base.data[i] = (unsigned char)next_random();
+	for (size_t i = 0; i < other_size; ++i)
+		other.data[i] = (unsigned char)next_random();
+
+	buffer patch = { NULL, 0 };
+	buffer patched = { malloc(base_size), base_size };
+	memcpy(patched.data, base.data, base_size);
+	unsigned char data[32];
+	for (size_t i = 0; i < sizeof(data); ++i)
+		data[i] = (unsigned char)next_random();
+	append(&patch, "PATCH", 5);
+	append_be(&patch, (uint32_t)offset, 3);
+	if (fill < 0)
+	{
+		append_be(&patch, (uint32_t)size, 2);
+		append(&patch, data, size);
+	}
+	else
+	{
+		append_be(&patch, 0, 2);
+		append_be(&patch, (uint32_t)size, 2);
+		append_be(&patch, (uint32_t)fill, 1);
+	}
+	append(&patch, "EOF", 3);
+	offline_patch(&patched, offset, fill < 0 ? data : NULL, size, fill);
+
+	unsigned char *memory = malloc(other_offset + other_size + SENTINEL_SIZE);
+	memset(memory, SENTINEL, other_offset + other_size + SENTINEL_SIZE);
+	load_list list;
+	load_list_initialize(&list);
+	load_list_add(&list, "SD:/base.bin", 0, memory, LOAD_TO_END, 0);
+	load_list_add(&list, "SD:/other.bin", 0, memory + other_offset, LOAD_TO_END, 0);
+	load_list_set_patch(&list, "SD:/base.bin", "SD:/patch.ips");
+
+	bool ok = a9l_host_put("SD:/base.bin", base.data, base.size) &&
+		a9l_host_put("SD:/other.bin", other.data, other.size) &&
+		a9l_host_put("SD:/patch.ips", patch.data, patch.size);
+	int res = load_list_run(&list);
+	ok = ok && (res == 0) == fits &&
+		memcmp(memory + other_offset, other.data, other_size) == 0 &&
+		untouched(memory + other_offset + other_size, SENTINEL_SIZE);
+	if (fits)
+		ok = ok && memcmp(memory, patched.data, patched.size) == 0;
+	else
+		ok = ok && untouched(memory + base_size, other_offset - base_size);
+
+	if (!ok)
+		printf("  record of %zu bytes at %zu%s\n", size, offset, fill < 0 ? "" : ", run length encoded");
+
+	free(memory);
+	free(base.data);
+	free(other.data);
+	free(patch.data);
+	free(patched.data);
+	return ok;
+}
+
+//A 4 MiB payload with 64 small changes, loaded as a base file and a patch and
+//as a file with the changes already in it
+static void time_loads(void)
+{
+	const size_t size = 4u << 20;
+	buffer base = { malloc(size), size };
+	for (size_t i = 0; i < size; ++i)
+		base.data[i] = (unsigned char)next_random();
+
+	buffer patch = { NULL, 0 };
+	buffer patched = { malloc(size), size };
+	memcpy(patched.data, base.data, size);
+	append(&patch, "PATCH", 5);
+	for (size_t i = 0; i < 64; ++i)
+	{
+		unsigned char data[32];
+		size_t offset = random_below((uint32_t)(size - sizeof(data)));
+		for (size_t j = 0; j < sizeof(data); ++j)
+			data[j] = (unsigned char)next_random();
+		append_be(&patch, (uint32_t)offset, 3);
+		append_be(&patch, sizeof(data), 2);
+		append(&patch, data, sizeof(data));
+		offline_patch(&patched, offset, data, sizeof(data), -1);
+	}
+	append(&patch, "EOF", 3);
+
+	unsigned char *destination = malloc(size);
+	if (!a9l_host_put("SD:/base.bin", base.data, base.size) ||
+		!a9l_host_put("SD:/patch.ips", patch.data, patch.size) ||
+		!a9l_host_put("SD:/patched.bin", patched.data, patched.size))
+		return;
+
+	//An SD card with 1 ms per request, reading 12 MB/s
+	a9l_host_set_device("SD:", A9L_TIMER_FREQUENCY / 1000u, 12000000u, 0);
+
+	uint64_t patched_ticks, prepatched_ticks;
+	double patched_time = load_time("SD:/base.bin", "SD:/patch.ips", destination, 20, &patched_ticks);
+	CHECK(memcmp(destination, patched.data, size) == 0);
+	double prepatched_time = load_time("SD:/patched.bin", NULL, destination, 20, &prepatched_ticks);
+	CHECK(memcmp(destination, patched.data, size) == 0);
+
+	printf("4 MiB payload, %zu byte patch with 64 records:\n", patch.size);
+	printf("  simulated SD: patched load %.2f ms, pre-patched file %.2f ms\n",
+		patched_ticks * 1000.0 / A9L_TIMER_FREQUENCY, prepatched_ticks * 1000.0 / A9L_TIMER_FREQUENCY);
+	printf("  host:         patched load %.3f ms, pre-patched file %.3f ms\n",
+		patched_time * 1000.0, prepatched_time * 1000.0);
+
+	//The patch is a couple of KiB next to 4 MiB of payload
+	CHECK(patched_ticks < prepatched_ticks + prepatched_ticks / 20);
+
+	a9l_host_set_device("SD:", 0, 0, 0);
+	free(destination);
+	free(base.data);
+	free(patch.data);
+	free(patched.data);
+}
+
+//Returns the fastest of repeats loads in seconds of host time, and sets ticks
+//to the simulated time of one
+static double load_time(const char *payload, const char *patch, void *destination, size_t repeats, uint64_t *ticks)
+{
+	double best = 0.0;
+	for (size_t i = 0; i < repeats; ++i)
+	{
+		load_list list;
+		load_list_initialize(&list);
+		load_list_add(&list, payload, 0, destination, LOAD_TO_END, 0);
+		if (patch)
+			load_list_set_patch(&list, payload, patch);
+
+		uint64_t start_ticks = a9l_host_clock();
+		double start = now();
+		CHECK(load_list_run(&list) == 0);
+		double elapsed = now() - start;
+		*ticks = a9l_host_clock() - start_ticks;
+		if (!i || elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+//Random records, normal and run length encoded, mostly over the file and
+//sometimes past its end. patched starts as the base file and is patched
+//offline along the way.
+static void build_patch(buffer *patch, buffer *patched, size_t base_size)
+{
+	append(patch, "PATCH", 5);
+	size_t records = random_below(MAX_RECORDS + 1);
+	for (size_t i = 0; i < records; ++i)
+	{
+		size_t offset = random_below((uint32_t)base_size + MAX_PAST_END);
+		append_be(patch, (uint32_t)offset, 3);
+		if (random_below(8))
+		{
+			unsigned char data[MAX_RECORD_SIZE];
+			size_t size = 1 + random_below(MAX_RECORD_SIZE);
+			for (size_t j = 0; j < size; ++j)
+				data[j] = (unsigned char)next_random();
+			append_be(patch, (uint32_t)size, 2);
+			append(patch, data, size);
+			offline_patch(patched, offset, data, size, -1);
+		}
+		else
+		{
+			size_t size = 1 + random_below(MAX_RLE_SIZE);
+			int fill = (int)random_below(256);
+			append_be(patch, 0, 2);
+			append_be(patch, (uint32_t)size, 2);
+			append_be(patch, (uint32_t)fill, 1);
+			offline_patch(patched, offset, NULL, size, fill);
+		}
+	}
+	append(patch, "EOF", 3);
+}
+
+//The reference patcher: writes a record into the whole file, growing it with
+//zeroes when the record starts past its end
+static void offline_patch(buffer *file, size_t offset, const unsigned char *data, size_t size, int fill)
+{
+	if (offset + size > file->size)
+	{
+		file->data = realloc(file->data, offset + size);
+		if (offset > file->size)
+			memset(file->data + file->size, 0, offset - file->size);
+		file->size = offset + size;
+	}
+
+	if (fill < 0)
+		memcpy(file->data + offset, data, size);
+	else
+		memset(file->data + offset, fill, size);
+}
+
+static void append(buffer *out, const void *data, size_t size)
+{
+	out->data = realloc(out->data, out->size + size);
+	memcpy(out->data + out->size, data, size);
+	out->size += size;
+}
+
+static void append_be(buffer *out, uint32_t value, size_t bytes)
+{
+	unsigned char data[4];
+	for (size_t i = 0; i < bytes; ++i)
+		data[i] = (unsigned char)(value >> (8 * (bytes - 1 - i)));
+	append(out, data, bytes);
+}
+
+static bool untouched(const unsigned char *data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (data[i] != SENTINEL)
+			return false;
+	}
+	return true;
+}
+
+//xorshift64*
+static uint32_t next_random(void)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (uint32_t)((state * 2685821657736338717ull) >> 32);
+}
+
+static uint32_t random_below(uint32_t limit)
+{
+	return limit ? next_random() % limit : 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
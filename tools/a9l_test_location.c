@@ -0,0 +1,140 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host test for fallback payload locations and the location memo. Builds
+//src/a9l_location.c and src/a9l_memo.c against the host layer, with the four
+//drives as directories, and boots against drive images that go missing, get
+//reordered, and have the payload moved between them. Checks which location is
+//picked, that the remembered one is tried first so a normal boot takes a single
+//stat, and that the memo survives from boot to boot through the SD card.
+//
+//Build and run with:
+//  make -C tools a9l_test_location && ./tools/a9l_test_location
+
+#include "a9l_location.h"
+#include "a9l_memo.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+static const char * const all_drives[] = { "SD:", "CTRNAND:", "TWLN:", "TWLP:" };
+static char * const locations[] = { "SD:/a9/gm9.bin", "CTRNAND:/gm9.bin", "gm9.bin" };
+static const size_t num_locations = sizeof(locations)/sizeof(*locations);
+
+static char root[1024];
+static char images[4][1100];
+static uint64_t stats;
+
+static void insert(const char *sd, const char *ctrnand);
+static size_t boot(const char *config_drive, char *resolved, size_t resolved_size, bool *memo_written);
+
+int main(void)
+{
+	if (!a9l_host_temp_directory(root, sizeof(root)))
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+	for (size_t i = 0; i < 4; ++i)
+	{
+		snprintf(images[i], sizeof(images[i]), "%s/%zu", root, i);
+		mkdir(images[i], 0755);
+	}
+
+	char resolved[256];
+	bool written;
+
+	printf("No SD card\n");
+	insert(NULL, images[1]);
+	a9l_host_put_text("CTRNAND:/arm9launcher.cfg", "CTRNAND:/arm9launcher.cfg");
+	a9l_host_put_text("CTRNAND:/gm9.bin", "CTRNAND:/gm9.bin");
+	CHECK(a9l_location_find_file("/arm9launcher.cfg", all_drives, 4) == all_drives[1]);
+	CHECK(boot("CTRNAND:", resolved, sizeof(resolved), &written) == 1);
+	CHECK(strcmp(resolved, "CTRNAND:/gm9.bin") == 0);
+	CHECK(!written);
+
+	printf("SD card inserted, first boot\n");
+	insert(images[0], images[1]);
+	CHECK(boot("CTRNAND:", resolved, sizeof(resolved), &written) == 1);
+	CHECK(stats == 2);
+	CHECK(written);
+	CHECK(a9l_host_get_counters()->writes > 0);
+
+	printf("Second boot\n");
+	insert(images[0], images[1]);
+	CHECK(boot("CTRNAND:", resolved, sizeof(resolved), &written) == 1);
+	CHECK(stats == 1);
+	CHECK(strcmp(resolved, "CTRNAND:/gm9.bin") == 0);
+	CHECK(!written);
+
+	printf("Payload moved to the SD card\n");
+	a9l_host_put_text("SD:/a9/gm9.bin", "SD:/a9/gm9.bin");
+	a9l_host_delete("CTRNAND:/gm9.bin");
+	CHECK(boot("CTRNAND:", resolved, sizeof(resolved), &written) == 0);
+	CHECK(stats == 2);
+	CHECK(strcmp(resolved, "SD:/a9/gm9.bin") == 0);
+	CHECK(written);
+	CHECK(boot("CTRNAND:", resolved, sizeof(resolved), &written) == 0);
+	CHECK(stats == 1);
+
+	printf("SD and CTRNAND images swapped\n");
+	insert(images[1], images[0]);
+	a9l_host_put_text("SD:/gm9.bin", "SD:/gm9.bin");
+	CHECK(a9l_location_find_file("/arm9launcher.cfg", all_drives, 4) == all_drives[0]);
+	CHECK(boot("SD:", resolved, sizeof(resolved), &written) == 2);
+	CHECK(strcmp(resolved, "SD:/gm9.bin") == 0);
+	CHECK(stats == 3);
+	CHECK(boot("SD:", resolved, sizeof(resolved), &written) == 2);
+	CHECK(stats == 1);
+
+	printf("Locations that don't fit\n");
+	insert(images[1], images[0]);
+	CHECK(!a9l_location_resolve("SD:/gm9.bin", "SD:", resolved, 8));
+	CHECK(!a9l_location_resolve("VERYLONGDRIVENAME:/gm9.bin", "SD:", resolved, sizeof(resolved)));
+
+	printf("Payload gone from every drive\n");
+	insert(images[2], images[3]);
+	CHECK(boot("SD:", resolved, sizeof(resolved), &written) == num_locations);
+	CHECK(stats == num_locations);
+	CHECK(!written);
+
+	a9l_host_remove_directory(root);
+	return a9l_host_finish();
+}
+
+//Helper functions follow
+
+//Maps the SD and CTRNAND drives to images, NULL for a missing drive. The TWL
+//partitions are always there, and empty.
+static void insert(const char *sd, const char *ctrnand)
+{
+	a9l_host_reset();
+	a9l_host_map_drive("SD:", sd);
+	a9l_host_map_drive("CTRNAND:", ctrnand);
+	a9l_host_map_drive("TWLN:", images[2]);
+	a9l_host_map_drive("TWLP:", images[3]);
+}
+
+//The loader's part of a boot that finds the payload. stats is set to the
+//number of stats it took, the counters cover the memo write too.
+static size_t boot(const char *config_drive, char *resolved, size_t resolved_size, bool *memo_written)
+{
+	a9l_memo memo;
+	a9l_memo_read(&memo, A9L_MEMO_FILE);
+	a9l_host_reset_counters();
+
+	size_t found = a9l_location_find_remembered(&memo, locations, num_locations, config_drive, resolved, resolved_size);
+	stats = a9l_host_get_counters()->stats;
+
+	*memo_written = memo.dirty && a9l_memo_write(&memo, A9L_MEMO_FILE);
+	return found;
+}
+
@@ -0,0 +1,326 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Test and benchmark for the copy and fill kernels in src/a9l_mem.c. Runs random
+//sizes and source and destination alignments through a9l_mem_copy,
+//a9l_mem_zero, a9l_mem_fill and a9l_mem_copy_volatile, and compares the region
+//and the bytes around it with what the byte at a time reference versions
+//leave. It then times the kernels against the references and the C library.
+//
+//Only src/a9l_mem.c is built, so this runs on the ARM kernels too with a cross
+//compiler and qemu-arm, see check-arm in tools/Makefile.
+//
+//Build and run with:
+//  make -C tools a9l_test_mem && ./tools/a9l_test_mem
+//  ./tools/a9l_test_mem -n 1000000 -s 1234
+
+#include "a9l_mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SIZE 0x4000u
+//Room around the region for misalignment and to catch stray writes
+#define MARGIN 64u
+#define BUFFER_SIZE (MAX_SIZE + 2u * MARGIN)
+
+//Long enough for the clock's resolution not to matter
+#define BENCH_MIN_TIME 0.02
+#define BENCH_ROUNDS 5u
+#define BENCH_MAX_SIZE (1024u * 1024u)
+
+typedef enum
+{
+	COPY,
+	ZERO,
+	COPY_VOLATILE,
+	FILL,
+} operation;
+
+static const char *operation_names[] = { "copy", "zero", "copy_volatile", "fill" };
+
+static unsigned char source[BUFFER_SIZE];
+static unsigned char actual[BUFFER_SIZE];
+static unsigned char expected[BUFFER_SIZE];
+static int failures;
+static uint64_t state;
+
+static bool run_case(operation op, size_t size, size_t dest_offset, size_t source_offset);
+static size_t random_size(void);
+static void bench(void);
+static double bench_one(void (*function)(void *, const void *, size_t), void *dest, const void *src, size_t size);
+static void copy_kernel(void *dest, const void *src, size_t size);
+static void copy_reference(void *dest, const void *src, size_t size);
+static void copy_libc(void *dest, const void *src, size_t size);
+static void zero_kernel(void *dest, const void *src, size_t size);
+static void zero_reference(void *dest, const void *src, size_t size);
+static void zero_libc(void *dest, const void *src, size_t size);
+static uint32_t next_random(void);
+static uint32_t random_below(uint32_t limit);
+static double now(void);
+
+int main(int argc, char *argv[])
+{
+	size_t cases = 200000;
+	uint64_t seed = (uint64_t)time(NULL);
+	bool benchmark = true;
+	int option;
+	while ((option = getopt(argc, argv, "n:s:B")) != -1)
+	{
+		switch (option)
+		{
+			case 'n':
+				cases = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			case 'B':
+				benchmark = false;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n cases] [-s seed] [-B]\n", argv[0]);
+				return 2;
+		}
+	}
+
+#if defined(__arm__) && !defined(__thumb__)
+	printf("ARM LDM/STM kernels\n");
+#else
+	printf("Portable kernels\n");
+#endif
+	printf("%zu random cases, seed %llu\n", cases, (unsigned long long)seed);
+	state = seed ? seed : 1;
+
+	//Every size up to a few blocks at every alignment, then random ones
+	for (size_t size = 0; size <= 100 && !failures; ++size)
+	{
+		for (size_t offsets = 0; offsets < 64 && !failures; ++offsets)
+		{
+			for (operation op = COPY; op <= FILL && !failures; ++op)
+			{
+				if (!run_case(op, size, offsets / 8, offsets % 8))
+					failures++;
+			}
+		}
+	}
+	for (size_t i = 0; i < cases && !failures; ++i)
+	{
+		if (!run_case((operation)random_below(4), random_size(), random_below(8), random_below(8)))
+		{
+			printf("  case %zu failed, rerun with -s %llu\n", i, (unsigned long long)seed);
+			failures++;
+		}
+	}
+
+	if (benchmark && !failures)
+		bench();
+
+	printf("%s\n", failures ? "FAILED" : "All tests passed");
+	return failures ? 1 : 0;
+}
+
+//Helper functions follow
+
+//Runs the operation on one buffer and the reference on another, both filled
+//with the same random bytes, and compares them. Only the region and the
+//margins around it are refilled; past a passing case the rest is the same in
+//both buffers already.
+static bool run_case(operation op, size_t size, size_t dest_offset, size_t source_offset)
+{
+	size_t span = size + 2u * MARGIN;
+	for (size_t i = 0; i < span; ++i)
+	{
+		source[i] = (unsigned char)next_random();
+		actual[i] = expected[i] = (unsigned char)next_random();
+	}
+
+	unsigned char *dest = actual + MARGIN + dest_offset;
+	unsigned char *reference = expected + MARGIN + dest_offset;
+	const unsigned char *src = source + MARGIN + source_offset;
+	switch (op)
+	{
+		case COPY:
+			a9l_mem_copy(dest, src, size);
+			a9l_mem_copy_reference(reference, src, size);
+			break;
+		case ZERO:
+			a9l_mem_zero(dest, size);
+			a9l_mem_zero_reference(reference, size);
+			break;
+		case FILL:
+			//The source's first byte, so it's random and the same for both
+			a9l_mem_fill(dest, src[0], size);
+			a9l_mem_fill_reference(reference, src[0], size);
+			break;
+		case COPY_VOLATILE:
+		default:
+			a9l_mem_copy_volatile(dest, src, size);
+			a9l_mem_copy_reference(reference, src, size);
+			break;
+	}
+
+	if (memcmp(actual, expected, span) == 0)
+		return true;
+
+	size_t first = 0;
+	while (actual[first] == expected[first])
+		first++;
+	printf("  %s of %zu bytes, destination offset %zu, source offset %zu: byte %ld differs\n",
+		operation_names[op], size, dest_offset, source_offset, (long)first - (long)(MARGIN + dest_offset));
+	return false;
+}
+
+//Mostly small, as the head and tail handling is where mistakes hide
+static size_t random_size(void)
+{
+	switch (random_below(4))
+	{
+		case 0:
+			return random_below(16);
+		case 1:
+			return random_below(128);
+		case 2:
+			return random_below(1024);
+		default:
+			return random_below(MAX_SIZE + 1);
+	}
+}
+
+static void bench(void)
+{
+	static const size_t sizes[] = { 64u, 4096u, BENCH_MAX_SIZE };
+	//Destination and source offsets: both aligned, both off by the same, and
+	//off from each other
+	static const size_t offsets[][2] = { { 0, 0 }, { 1, 1 }, { 0, 1 } };
+
+	unsigned char *dest = malloc(BENCH_MAX_SIZE + 8u);
+	unsigned char *src = malloc(BENCH_MAX_SIZE + 8u);
+	if (!dest || !src)
+	{
+		printf("Unable to allocate benchmark buffers\n");
+		failures++;
+		free(dest);
+		free(src);
+		return;
+	}
+	memset(src, 0x5A, BENCH_MAX_SIZE + 8u);
+
+	printf("MB/s          size offsets     kernel  reference       libc\n");
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(*sizes); ++i)
+	{
+		for (size_t j = 0; j < sizeof(offsets)/sizeof(*offsets); ++j)
+		{
+			unsigned char *d = dest + offsets[j][0];
+			const unsigned char *s = src + offsets[j][1];
+			printf("copy %9zu     %zu, %zu %10.0f %10.0f %10.0f\n", sizes[i], offsets[j][0], offsets[j][1],
+				bench_one(copy_kernel, d, s, sizes[i]), bench_one(copy_reference, d, s, sizes[i]),
+				bench_one(copy_libc, d, s, sizes[i]));
+		}
+		for (size_t j = 0; j < 2; ++j)
+		{
+			unsigned char *d = dest + offsets[j][0];
+			printf("zero %9zu        %zu %10.0f %10.0f %10.0f\n", sizes[i], offsets[j][0],
+				bench_one(zero_kernel, d, NULL, sizes[i]), bench_one(zero_reference, d, NULL, sizes[i]),
+				bench_one(zero_libc, d, NULL, sizes[i]));
+		}
+	}
+
+	free(dest);
+	free(src);
+}
+
+//Best throughput over a few rounds, in MB/s
+static double bench_one(void (*function)(void *, const void *, size_t), void *dest, const void *src, size_t size)
+{
+	size_t iterations = 1;
+	double elapsed;
+	for (;;)
+	{
+		double start = now();
+		for (size_t i = 0; i < iterations; ++i)
+			function(dest, src, size);
+		elapsed = now() - start;
+		if (elapsed >= BENCH_MIN_TIME)
+			break;
+		iterations *= 2;
+	}
+
+	for (size_t round = 1; round < BENCH_ROUNDS; ++round)
+	{
+		double start = now();
+		for (size_t i = 0; i < iterations; ++i)
+			function(dest, src, size);
+		double time = now() - start;
+		if (time < elapsed)
+			elapsed = time;
+	}
+	return (double)size * (double)iterations / elapsed / 1e6;
+}
+
+//Through pointers, so the compiler can't see through or drop the calls
+static void copy_kernel(void *dest, const void *src, size_t size)
+{
+	a9l_mem_copy(dest, src, size);
+}
+
+static void copy_reference(void *dest, const void *src, size_t size)
+{
+	a9l_mem_copy_reference(dest, src, size);
+}
+
+static void copy_libc(void *dest, const void *src, size_t size)
+{
+	memcpy(dest, src, size);
+	__asm__ volatile("" : : "r" (dest) : "memory");
+}
+
+static void zero_kernel(void *dest, const void *src, size_t size)
+{
+	(void)src;
+	a9l_mem_zero(dest, size);
+}
+
+static void zero_reference(void *dest, const void *src, size_t size)
+{
+	(void)src;
+	a9l_mem_zero_reference(dest, size);
+}
+
+static void zero_libc(void *dest, const void *src, size_t size)
+{
+	(void)src;
+	memset(dest, 0, size);
+	__asm__ volatile("" : : "r" (dest) : "memory");
+}
+
+static uint32_t next_random(void)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (uint32_t)((state * 2685821657736338717ull) >> 32);
+}
+
+static uint32_t random_below(uint32_t limit)
+{
+	return limit ? next_random() % limit : 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
@@ -0,0 +1,196 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host test for the payload prefetch. Builds src/a9l_prefetch.c with the
+//selection and resident cache code against the host layer, with the SD card
+//as a simulated device that can read in the background. Boots the way the
+//loader and bootloader do with --enable-prefetch, and compares them with the
+//same boots without it: cold boots that select the last payload again, which
+//should save the time the loader spent resolving the configuration, boots
+//that select another one, which should cost at most stopping the read, soft
+//resets, and a drive that can only do blocking reads.
+//
+//Build and run with:
+//  make -C tools a9l_test_prefetch && ./tools/a9l_test_prefetch
+
+#include "a9l_prefetch.h"
+#include "a9l_resident.h"
+#include "a9l_select.h"
+#include "a9l_memo.h"
+#include "a9l_timer.h"
+#include "a9l_trace.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define KIB 1024u
+#define MIB (1024u * 1024u)
+#define MS (A9L_TIMER_FREQUENCY / 1000u)
+
+#define LATENCY (1u * MS)
+#define BANDWIDTH (12u * MIB)
+//What the loader does between starting the prefetch and finishing it, less
+//than it takes to read either payload
+#define WORK (40u * MS)
+
+static const char config[] =
+	"{ \"configuration\" : [\n"
+	"	{ \"name\" : \"A\", \"location\" : \"a.bin\", \"buttons\" : [\"None\"] },\n"
+	"	{ \"name\" : \"B\", \"location\" : \"b.bin\", \"buttons\" : [\"Y\"] }\n"
+	"] }\n";
+
+static char root[1024];
+static unsigned char payload_a[1 * MIB];
+static unsigned char payload_b[768 * KIB];
+
+static bool boot(ctr_hid_button_type buttons, bool prefetching, uint64_t *ticks);
+static void power_off(void);
+static void fill(unsigned char *data, size_t size, uint32_t seed);
+
+int main(void)
+{
+	if (!a9l_host_temp_directory(root, sizeof(root)))
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+	if (!a9l_host_map_memory(A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE))
+	{
+		printf("Unable to map the ARM9 addresses on this host\n");
+		a9l_host_remove_directory(root);
+		return 1;
+	}
+	a9l_host_reset();
+	a9l_host_map_drive("SD:", root);
+	a9l_host_set_device("SD:", LATENCY, BANDWIDTH, 0);
+	a9l_host_set_async("SD:", true);
+
+	fill(payload_a, sizeof(payload_a), 1);
+	fill(payload_b, sizeof(payload_b), 2);
+	a9l_host_put("SD:/arm9launcher.cfg", config, sizeof(config) - 1);
+	a9l_host_put("SD:/a.bin", payload_a, sizeof(payload_a));
+	a9l_host_put("SD:/b.bin", payload_b, sizeof(payload_b));
+
+	uint64_t plain, prefetched;
+
+	printf("First boot\n");
+	power_off();
+	CHECK(boot(CTR_HID_NONE, true, &prefetched));
+	CHECK(a9l_host_get_counters()->async_reads == 0);
+	CHECK(a9l_host_get_counters()->prefetch_hits + a9l_host_get_counters()->prefetch_misses == 0);
+
+	printf("Cold boot, same payload\n");
+	power_off();
+	CHECK(boot(CTR_HID_NONE, false, &plain));
+	power_off();
+	CHECK(boot(CTR_HID_NONE, true, &prefetched));
+	CHECK(a9l_host_get_counters()->prefetch_hits == 1);
+	printf("  %.1f ms without prefetch, %.1f ms with\n", (double)plain / MS, (double)prefetched / MS);
+	//All of the work overlaps the read, less the bootloader's check of the copy
+	CHECK(prefetched + WORK - 8u * LATENCY <= plain);
+
+	printf("Soft reset\n");
+	CHECK(boot(CTR_HID_NONE, true, &prefetched));
+	CHECK(a9l_host_get_counters()->async_reads == 0);
+	CHECK(a9l_host_get_counters()->prefetch_hits + a9l_host_get_counters()->prefetch_misses == 0);
+
+	printf("Cold boot, other payload\n");
+	power_off();
+	CHECK(boot(CTR_HID_Y, false, &plain));
+	CHECK(boot(CTR_HID_NONE, false, &prefetched));
+	power_off();
+	CHECK(boot(CTR_HID_Y, true, &prefetched));
+	CHECK(a9l_host_get_counters()->prefetch_misses == 1);
+	printf("  %.1f ms without prefetch, %.1f ms with\n", (double)plain / MS, (double)prefetched / MS);
+	//Stopping the read is one more request
+	CHECK(prefetched <= plain + LATENCY);
+	CHECK(boot(CTR_HID_Y, true, &prefetched));
+	CHECK(a9l_host_get_counters()->async_reads == 0);
+
+	printf("Drive without background reads\n");
+	a9l_host_set_async("SD:", false);
+	power_off();
+	CHECK(boot(CTR_HID_Y, false, &plain));
+	power_off();
+	CHECK(boot(CTR_HID_Y, true, &prefetched));
+	CHECK(a9l_host_get_counters()->async_reads == 0);
+	CHECK(a9l_host_get_counters()->prefetch_hits + a9l_host_get_counters()->prefetch_misses == 0);
+	CHECK(prefetched == plain);
+
+	a9l_host_remove_directory(root);
+	return a9l_host_finish();
+}
+
+//Helper functions follow
+
+//The loader's part of a boot from reading the configuration on, then the
+//bootloader's read of the payload through the resident cache. Checks the
+//payload read is the selected file's contents, and sets ticks to how long all
+//of it took.
+static bool boot(ctr_hid_button_type buttons, bool prefetching, uint64_t *ticks)
+{
+	a9l_host_reset_counters();
+	uint64_t start = a9l_host_clock();
+	a9l_resident cache;
+	a9l_resident_initialize(&cache, (void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE);
+
+	char buffer[sizeof(config)] = { 0 };
+	FILE *file = a9l_trace_fopen("SD:/arm9launcher.cfg", "rb");
+	if (!file)
+		return false;
+	bool res = 1 == a9l_trace_fread(buffer, sizeof(config) - 1, 1, file);
+	a9l_trace_fclose(file);
+
+	a9l_memo memo;
+	a9l_memo_read(&memo, A9L_MEMO_FILE);
+	a9l_prefetch prefetch;
+	a9l_prefetch_start(&prefetch, &cache, prefetching && memo.has_selection ? memo.selection.payload : NULL);
+
+	a9l_selection selection;
+	memset(&selection, 0, sizeof(selection));
+	const char *error = NULL;
+	res = res && a9l_select(&selection, &memo, "SD:", buffer, sizeof(config) - 1, buttons, &error);
+	a9l_host_advance(WORK);
+	a9l_prefetch_finish(&prefetch, res ? selection.payload : NULL);
+	a9l_memo_write(&memo, A9L_MEMO_FILE);
+	if (!res)
+		return false;
+
+	const unsigned char *expected = buttons == CTR_HID_Y ? payload_b : payload_a;
+	size_t expected_size = buttons == CTR_HID_Y ? sizeof(payload_b) : sizeof(payload_a);
+	file = a9l_trace_fopen(selection.payload, "rb");
+	if (!file)
+		return false;
+	size_t size = 0;
+	const void *image = a9l_resident_load(&cache, selection.payload, file, &size);
+	res = image && size == expected_size && memcmp(image, expected, size) == 0;
+	a9l_trace_fclose(file);
+
+	*ticks = a9l_host_clock() - start;
+	return res;
+}
+
+//The resident region doesn't survive a power cycle
+static void power_off(void)
+{
+	fill((void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE / 64u, 3);
+}
+
+static void fill(unsigned char *data, size_t size, uint32_t seed)
+{
+	uint32_t state = seed * 2654435761u + 1;
+	for (size_t i = 0; i < size; ++i)
+	{
+		state = state * 1664525u + 1013904223u;
+		data[i] = (unsigned char)(state >> 24);
+	}
+}
+
@@ -0,0 +1,320 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host test for the resident payload cache. Builds src/a9l_resident.c with the
+//real ELF and load list code against the host layer, and maps the ARM9's
+//FCRAM addresses so payloads load where they would on the console. The
+//reserved region at A9L_RESIDENT_ADDR is only mapped once, so what the last
+//simulated boot left there is what the next one finds, like after a soft
+//reset. Boots raw and ELF payloads the way src/arm9launcher.c does, and checks
+//which boots are served from the region and that what gets loaded is always
+//the file's current contents: after edits that keep the size and modification
+//time, files without a modification time, a corrupted region, payloads too
+//large for it, and loads that overwrite it.
+//
+//Build and run with:
+//  make -C tools a9l_test_resident && ./tools/a9l_test_resident
+
+#include "a9l_resident.h"
+#include "load_list.h"
+#include "elf.h"
+#include "a9l_trace.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+//Where the launcher puts raw payloads, and the FCRAM mapped for them and ELF
+//segments
+#define RAW_ADDRESS 0x23F00000u
+#define FCRAM_ADDRESS 0x20000000u
+#define FCRAM_SIZE 0x04000000u
+
+#define SEGMENT_ADDRESS 0x20100000u
+#define SEGMENT_SIZE 0x10000u
+#define DATA_ADDRESS 0x20180000u
+#define DATA_SIZE 0x8000u
+#define BSS_SIZE 0x4000u
+#define DATA_OFFSET (0x100u + SEGMENT_SIZE)
+
+//A hit only reads the sample blocks, and the headers out of the region
+#define HIT_READ_LIMIT 4096u
+
+#define FILE_TIME 1500000000
+
+static char root[1024];
+static unsigned char raw[300 * 1024];
+static unsigned char elf[DATA_OFFSET + DATA_SIZE + 0x4000];
+static unsigned char large[A9L_RESIDENT_SIZE / 2];
+
+static int boot(const char *path, size_t offset, const char *extra, uint32_t extra_address, size_t region_size, bool *cached);
+static bool raw_loaded(const unsigned char *data, size_t offset, size_t size);
+static bool elf_loaded(void);
+static void fill(unsigned char *data, size_t size, uint32_t seed);
+static void build_elf(void);
+static void write_u32(unsigned char *data, uint32_t value);
+static void write_u16(unsigned char *data, uint16_t value);
+
+int main(void)
+{
+	if (!a9l_host_temp_directory(root, sizeof(root)))
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+	if (!a9l_host_map_memory(FCRAM_ADDRESS, FCRAM_SIZE) ||
+		!a9l_host_map_memory(A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE))
+	{
+		printf("Unable to map the ARM9 addresses on this host\n");
+		a9l_host_remove_directory(root);
+		return 1;
+	}
+	a9l_host_reset();
+	a9l_host_map_drive("SD:", root);
+
+	//Whatever was in RAM at power on
+	fill((void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE, 1);
+	fill(raw, sizeof(raw), 2);
+	fill(large, sizeof(large), 3);
+	build_elf();
+	a9l_host_put_time("SD:/raw.bin", raw, sizeof(raw), FILE_TIME);
+	a9l_host_put_time("SD:/payload.elf", elf, sizeof(elf), FILE_TIME);
+
+	bool cached;
+
+	printf("Cold boot\n");
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(a9l_host_get_counters()->bytes_read >= sizeof(raw));
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+
+	printf("Soft reset\n");
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+	CHECK(boot("SD:/raw.bin", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(cached);
+	CHECK(raw_loaded(raw, 0, sizeof(raw)));
+
+	printf("Edited, same size and modification time\n");
+	raw[(sizeof(raw) - A9L_RESIDENT_SAMPLE_SIZE) / 3 + 10] ^= 0xFF;
+	a9l_host_put_time("SD:/raw.bin", raw, sizeof(raw), FILE_TIME);
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+	raw[sizeof(raw) - 1] ^= 0xFF;
+	a9l_host_put_time("SD:/raw.bin", raw, sizeof(raw), FILE_TIME);
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+
+	printf("Edited, modification time 2 seconds later\n");
+	raw[sizeof(raw) / 2 + 7] ^= 0xFF;
+	a9l_host_put_time("SD:/raw.bin", raw, sizeof(raw), FILE_TIME + 2);
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(cached);
+
+	printf("Region corrupted between boots\n");
+	a9l_resident cache;
+	a9l_resident_initialize(&cache, (void*)A9L_RESIDENT_ADDR, A9L_RESIDENT_SIZE);
+	cache.data[sizeof(raw) / 3 + 1] ^= 0x01;
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+	cache.header->file_size ^= 0x100;
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+
+	printf("No modification time\n");
+	a9l_host_put_time("SD:/raw.bin", raw, sizeof(raw), 0);
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(boot("SD:/raw.bin", 0x1000, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0x1000, sizeof(raw)));
+	a9l_host_put_time("SD:/raw.bin", raw, sizeof(raw), FILE_TIME);
+
+	printf("ELF payload\n");
+	CHECK(boot("SD:/payload.elf", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(elf_loaded());
+	CHECK(boot("SD:/payload.elf", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(cached);
+	CHECK(elf_loaded());
+	CHECK(boot("SD:/raw.bin", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0, sizeof(raw)));
+
+	printf("Payload larger than the region\n");
+	a9l_host_put_time("SD:/large.bin", large, sizeof(large), FILE_TIME);
+	CHECK(boot("SD:/large.bin", sizeof(large) - 0x10000, NULL, 0, sizeof(large) / 2, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(large, sizeof(large) - 0x10000, sizeof(large)));
+	CHECK(boot("SD:/large.bin", sizeof(large) - 0x10000, NULL, 0, sizeof(large) / 2, &cached) == 0);
+	CHECK(!cached);
+
+	printf("Load over the region\n");
+	CHECK(boot("SD:/raw.bin", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(boot("SD:/raw.bin", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(cached);
+	CHECK(boot("SD:/raw.bin", 0, "SD:/raw.bin", A9L_RESIDENT_ADDR + 0x1000, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(raw_loaded(raw, 0, sizeof(raw)));
+	CHECK(memcmp((void*)(A9L_RESIDENT_ADDR + 0x1000), raw, sizeof(raw)) == 0);
+	CHECK(boot("SD:/raw.bin", 0, NULL, 0, A9L_RESIDENT_SIZE, &cached) == 0);
+	CHECK(!cached);
+	CHECK(raw_loaded(raw, 0, sizeof(raw)));
+
+	a9l_host_remove_directory(root);
+	return a9l_host_finish();
+}
+
+//Helper functions follow
+
+//The launcher's part of a boot, with the cache over the first region_size
+//bytes of the region and an optional extra load of a whole file. cached is set
+//to whether the payload came out of the region.
+static int boot(const char *path, size_t offset, const char *extra, uint32_t extra_address, size_t region_size, bool *cached)
+{
+	memset((void*)FCRAM_ADDRESS, 0xCC, FCRAM_SIZE);
+	a9l_host_reset_counters();
+	*cached = false;
+
+	FILE *file = a9l_trace_fopen(path, "rb");
+	if (!file)
+		return -1;
+
+	FILE *source = file;
+	a9l_resident cache;
+	a9l_resident_initialize(&cache, (void*)A9L_RESIDENT_ADDR, region_size);
+	size_t image_size = 0;
+	void *image = a9l_resident_load(&cache, path, file, &image_size);
+	FILE *memory = image ? fmemopen(image, image_size, "rb") : NULL;
+	if (memory)
+		source = memory;
+
+	Elf32_Ehdr header;
+	load_header(&header, source);
+
+	load_list list;
+	load_list_initialize(&list);
+	int res;
+	if (check_elf(&header))
+	{
+		res = queue_segments(&header, source, path, &list);
+	}
+	else
+	{
+		size_t size = LOAD_TO_END;
+		if (memory && offset <= image_size)
+			size = image_size - offset;
+		res = load_list_add(&list, path, offset, (void*)RAW_ADDRESS, size, 0);
+	}
+	if (!res && extra)
+		res = load_list_add(&list, extra, 0, (void*)(uintptr_t)extra_address, LOAD_TO_END, 0);
+
+	if (memory)
+	{
+		if (load_list_overlaps(&list, path, (void*)A9L_RESIDENT_ADDR, region_size))
+			a9l_resident_invalidate(&cache);
+		else
+			load_list_set_image(&list, path, image, image_size);
+		fclose(memory);
+	}
+
+	if (res)
+	{
+		a9l_trace_fclose(file);
+		return res;
+	}
+	load_list_adopt_file(&list, path, file);
+	res = load_list_run(&list);
+	*cached = a9l_host_get_counters()->bytes_read < HIT_READ_LIMIT;
+	return res;
+}
+
+static bool raw_loaded(const unsigned char *data, size_t offset, size_t size)
+{
+	const unsigned char *loaded = (const unsigned char*)RAW_ADDRESS;
+	return memcmp(loaded, data + offset, size - offset) == 0 &&
+		loaded[size - offset] == 0xCC;
+}
+
+static bool elf_loaded(void)
+{
+	const unsigned char *bss = (const unsigned char*)(DATA_ADDRESS + DATA_SIZE);
+	for (size_t i = 0; i < BSS_SIZE; ++i)
+	{
+		if (bss[i])
+			return false;
+	}
+	return memcmp((void*)SEGMENT_ADDRESS, elf + 0x100, SEGMENT_SIZE) == 0 &&
+		memcmp((void*)DATA_ADDRESS, elf + DATA_OFFSET, DATA_SIZE) == 0 &&
+		bss[BSS_SIZE] == 0xCC;
+}
+
+static void fill(unsigned char *data, size_t size, uint32_t seed)
+{
+	uint32_t state = seed * 2654435761u + 1;
+	for (size_t i = 0; i < size; ++i)
+	{
+		state = state * 1664525u + 1013904223u;
+		data[i] = (unsigned char)(state >> 24);
+	}
+}
+
+//Two PT_LOAD segments, the second with a .bss, and trailing data that isn't
+//loaded, like section headers
+static void build_elf(void)
+{
+	fill(elf, sizeof(elf), 4);
+	memset(elf, 0, 0x100);
+	memcpy(elf, "\x7F" "ELF", 4);
+	elf[EI_CLASS] = 1;
+	elf[EI_DATA] = 1;
+	elf[EI_VERSION] = EV_CURRENT;
+	write_u16(elf + 16, ET_EXEC);
+	write_u16(elf + 18, EM_ARM);
+	write_u32(elf + 20, EV_CURRENT);
+	write_u32(elf + 24, SEGMENT_ADDRESS);
+	write_u32(elf + 28, 52);
+	write_u16(elf + 40, 52);
+	write_u16(elf + 42, ELF_PROGRAM_HEADER_SIZE);
+	write_u16(elf + 44, 2);
+
+	unsigned char *text = elf + 52;
+	write_u32(text, PT_LOAD);
+	write_u32(text + 4, 0x100);
+	write_u32(text + 8, SEGMENT_ADDRESS);
+	write_u32(text + 16, SEGMENT_SIZE);
+	write_u32(text + 20, SEGMENT_SIZE);
+
+	unsigned char *data = text + ELF_PROGRAM_HEADER_SIZE;
+	write_u32(data, PT_LOAD);
+	write_u32(data + 4, DATA_OFFSET);
+	write_u32(data + 8, DATA_ADDRESS);
+	write_u32(data + 16, DATA_SIZE);
+	write_u32(data + 20, DATA_SIZE + BSS_SIZE);
+}
+
+static void write_u32(unsigned char *data, uint32_t value)
+{
+	write_u16(data, (uint16_t)value);
+	write_u16(data + 2, (uint16_t)(value >> 16));
+}
+
+static void write_u16(unsigned char *data, uint16_t value)
+{
+	data[0] = (unsigned char)value;
+	data[1] = (unsigned char)(value >> 8);
+}
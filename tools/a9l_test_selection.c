@@ -0,0 +1,229 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host test for the remembered selection. Builds src/a9l_select.c and what it
+//uses against the host layer, and boots with configurations that change in
+//ways their size and modification time don't show, with different buttons,
+//from another drive, and with the remembered payload gone. Checks that the
+//configuration is only parsed when it has to be, that the selection is the
+//same as a fresh parse would give, and that the memo is only written when the
+//selection changes.
+//
+//Build and run with:
+//  make -C tools a9l_test_selection && ./tools/a9l_test_selection
+
+#include "a9l_select.h"
+#include "a9l_memo.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+
+//Both the same size, they differ only in where the Y entry points
+static const char config_y1[] =
+	"{ \"configuration\" : [\n"
+	"	{ \"name\" : \"A\", \"location\" : [\"SD:/a9/a.bin\", \"a.bin\"], \"buttons\" : [\"None\"] },\n"
+	"	{ \"name\" : \"B\", \"location\" : \"b.bin\", \"offset\" : 16, \"patch\" : \"b.ips\", \"buttons\" : [\"Y\"],\n"
+	"		\"loads\" : [ { \"location\" : \"c.bin\", \"address\" : 0x20000000 } ] }\n"
+	"] }\n";
+static const char config_y2[] =
+	"{ \"configuration\" : [\n"
+	"	{ \"name\" : \"A\", \"location\" : [\"SD:/a9/a.bin\", \"a.bin\"], \"buttons\" : [\"None\"] },\n"
+	"	{ \"name\" : \"B\", \"location\" : \"c.bin\", \"offset\" : 16, \"patch\" : \"b.ips\", \"buttons\" : [\"Y\"],\n"
+	"		\"loads\" : [ { \"location\" : \"c.bin\", \"address\" : 0x20000000 } ] }\n"
+	"] }\n";
+
+static char root[1024];
+static char images[2][1100];
+//Whether the last boot wrote the memo
+static bool memo_written;
+
+static void insert(void);
+static bool boot(const char *drive, const char *config, size_t config_size, ctr_hid_button_type buttons, a9l_selection *selection);
+static char *large_config(size_t entries, size_t *size);
+static double seconds(void);
+
+int main(void)
+{
+	if (!a9l_host_temp_directory(root, sizeof(root)))
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+	for (size_t i = 0; i < 2; ++i)
+	{
+		snprintf(images[i], sizeof(images[i]), "%s/%zu", root, i);
+		mkdir(images[i], 0755);
+	}
+
+	insert();
+	a9l_host_put_text("SD:/a9/a.bin", "a");
+	a9l_host_put_text("SD:/a.bin", "a");
+	a9l_host_put_text("SD:/b.bin", "b");
+	a9l_host_put_text("SD:/b.ips", "PATCHEOF");
+	a9l_host_put_text("SD:/c.bin", "c");
+	a9l_host_put_text("CTRNAND:/a.bin", "a");
+	a9l_host_put_text("CTRNAND:/b.bin", "b");
+	a9l_host_put_text("CTRNAND:/b.ips", "PATCHEOF");
+	a9l_host_put_text("CTRNAND:/c.bin", "c");
+
+	a9l_selection selection;
+	size_t size = sizeof(config_y1) - 1;
+
+	printf("First boot\n");
+	CHECK(boot("SD:", config_y1, size, CTR_HID_NONE, &selection));
+	CHECK(!selection.remembered);
+	CHECK(memo_written);
+	CHECK(strcmp(selection.payload, "SD:/a9/a.bin") == 0);
+	CHECK(selection.patch[0] == '\0' && selection.num_loads == 0);
+
+	printf("Second boot\n");
+	CHECK(boot("SD:", config_y1, size, CTR_HID_NONE, &selection));
+	CHECK(selection.remembered);
+	CHECK(!memo_written);
+	CHECK(strcmp(selection.payload, "SD:/a9/a.bin") == 0);
+	CHECK(a9l_host_get_counters()->selection_hits == 1);
+
+	printf("Different buttons\n");
+	CHECK(boot("SD:", config_y1, size, CTR_HID_Y, &selection));
+	CHECK(!selection.remembered);
+	CHECK(strcmp(selection.payload, "SD:/b.bin") == 0);
+	CHECK(selection.offset == 16);
+	CHECK(strcmp(selection.patch, "SD:/b.ips") == 0);
+	CHECK(selection.num_loads == 1);
+	CHECK(strcmp(selection.loads[0].location, "SD:/c.bin") == 0);
+	CHECK(strcmp(selection.loads[0].address, "0x20000000") == 0);
+	CHECK(boot("SD:", config_y1, size, CTR_HID_Y, &selection));
+	CHECK(selection.remembered);
+	CHECK(!memo_written);
+	CHECK(strcmp(selection.payload, "SD:/b.bin") == 0 && selection.offset == 16);
+	CHECK(strcmp(selection.patch, "SD:/b.ips") == 0);
+	CHECK(selection.num_loads == 1 && strcmp(selection.loads[0].location, "SD:/c.bin") == 0);
+
+	//An edit like this keeps the file's size, and the modification time too
+	//if the clock isn't set, so only the contents tell the two apart
+	printf("Configuration edited, same size\n");
+	CHECK(sizeof(config_y1) == sizeof(config_y2));
+	CHECK(boot("SD:", config_y2, size, CTR_HID_Y, &selection));
+	CHECK(!selection.remembered);
+	CHECK(memo_written);
+	CHECK(strcmp(selection.payload, "SD:/c.bin") == 0);
+	CHECK(boot("SD:", config_y2, size, CTR_HID_Y, &selection));
+	CHECK(selection.remembered);
+	CHECK(strcmp(selection.payload, "SD:/c.bin") == 0);
+
+	printf("Same configuration on another drive\n");
+	CHECK(boot("CTRNAND:", config_y2, size, CTR_HID_Y, &selection));
+	CHECK(!selection.remembered);
+	CHECK(strcmp(selection.payload, "CTRNAND:/c.bin") == 0);
+	CHECK(strcmp(selection.loads[0].location, "CTRNAND:/c.bin") == 0);
+
+	printf("Remembered payload gone\n");
+	CHECK(boot("SD:", config_y2, size, CTR_HID_NONE, &selection));
+	CHECK(boot("SD:", config_y2, size, CTR_HID_NONE, &selection));
+	CHECK(selection.remembered);
+	a9l_host_delete("SD:/a9/a.bin");
+	CHECK(boot("SD:", config_y2, size, CTR_HID_NONE, &selection));
+	CHECK(!selection.remembered);
+	CHECK(strcmp(selection.payload, "SD:/a.bin") == 0);
+	CHECK(boot("SD:", config_y2, size, CTR_HID_NONE, &selection));
+	CHECK(selection.remembered);
+	CHECK(strcmp(selection.payload, "SD:/a.bin") == 0);
+
+	printf("Entry that doesn't resolve\n");
+	a9l_host_delete("SD:/b.ips");
+	CHECK(!boot("SD:", config_y1, size, CTR_HID_Y, &selection));
+	CHECK(!boot("SD:", config_y1, size, CTR_HID_Y, &selection));
+
+	printf("Counts kept in the trace\n");
+	CHECK(a9l_host_get_counters()->selection_hits == 5);
+	CHECK(a9l_host_get_counters()->selection_misses == 8);
+
+	//A hit still reads and hashes the whole configuration, which should cost
+	//far less than parsing it
+	printf("Large configuration\n");
+	size_t large_size;
+	char *large = large_config(A9L_CONFIG_MAX_ENTRIES - 1, &large_size);
+	CHECK(large != NULL);
+	if (large)
+	{
+		double start = seconds();
+		CHECK(boot("SD:", large, large_size, CTR_HID_NONE, &selection));
+		double miss = seconds() - start;
+		CHECK(!selection.remembered);
+		start = seconds();
+		CHECK(boot("SD:", large, large_size, CTR_HID_NONE, &selection));
+		double hit = seconds() - start;
+		CHECK(selection.remembered);
+		CHECK(strcmp(selection.payload, "SD:/a.bin") == 0);
+		printf("  %zu bytes: %.3f ms parsed, %.3f ms remembered\n", large_size, miss * 1000, hit * 1000);
+		CHECK(hit * 4 < miss);
+		free(large);
+	}
+
+	a9l_host_remove_directory(root);
+	return a9l_host_finish();
+}
+
+//Helper functions follow
+
+static void insert(void)
+{
+	a9l_host_reset();
+	a9l_host_map_drive("SD:", images[0]);
+	a9l_host_map_drive("CTRNAND:", images[1]);
+}
+
+//The loader's part of a boot from the configuration on; the memo is read from
+//and written back to the SD card like the loader does
+static bool boot(const char *drive, const char *config, size_t config_size, ctr_hid_button_type buttons, a9l_selection *selection)
+{
+	a9l_memo memo;
+	a9l_memo_read(&memo, A9L_MEMO_FILE);
+	memset(selection, 0, sizeof(*selection));
+
+	const char *error = NULL;
+	bool res = a9l_select(selection, &memo, drive, config, config_size, buttons, &error);
+	if (!res)
+		printf("  %s\n", error);
+	uint64_t writes = a9l_host_get_counters()->writes;
+	a9l_memo_write(&memo, A9L_MEMO_FILE);
+	memo_written = a9l_host_get_counters()->writes > writes;
+	return res;
+}
+
+//Entries for buttons nobody presses, with the one for none at the end
+static char *large_config(size_t entries, size_t *size)
+{
+	size_t capacity = 128 + entries * 96;
+	char *config = malloc(capacity);
+	if (!config)
+		return NULL;
+
+	size_t used = (size_t)sprintf(config, "{ \"configuration\" : [\n");
+	for (size_t i = 0; i < entries; ++i)
+	{
+		used += (size_t)sprintf(config + used,
+			"\t{ \"name\" : \"%zu\", \"location\" : \"p%zu.bin\", \"buttons\" : [\"L\", \"R\", \"X\"] },\n", i, i);
+	}
+	used += (size_t)sprintf(config + used, "\t{ \"name\" : \"A\", \"location\" : \"a.bin\", \"buttons\" : [\"None\"] }\n] }\n");
+	*size = used;
+	return config;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
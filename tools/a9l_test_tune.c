@@ -0,0 +1,247 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host test for read size tuning. Builds src/a9l_tune.c against the host layer,
+//with the SD card as a stand-in device of configurable latency, bandwidth and
+//largest full speed request, and boots payloads of mixed sizes through
+//a9l_tune_fread. Checks that tuning settles on the chunk size the device model
+//says is fastest, that payloads smaller than a window on an untuned drive are
+//read as fast as without tuning, that settled boots don't rewrite the tuning
+//file, that
+//drift is counted once per boot, that a single slow boot doesn't start tuning
+//over, and that a device that changes for good gets tuned again.
+//
+//Build and run with:
+//  make -C tools a9l_test_tune && ./tools/a9l_test_tune
+
+#include "a9l_tune.h"
+#include "a9l_timer.h"
+#include "a9l_trace.h"
+#include "a9l_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define KIB 1024u
+#define MIB (1024u * 1024u)
+#define MS (A9L_TIMER_FREQUENCY / 1000u)
+
+//Stand-in for a drive, see a9l_host_set_device
+typedef struct
+{
+	uint32_t latency;
+	uint32_t bandwidth;
+	size_t knee;
+} device;
+
+//Largest requests at full speed, the smaller ones pay for latency
+static const device fast_sd = { 1u * MS, 12u * MIB, 256u * KIB };
+//Same drive, transfers at half speed
+static const device slow_sd = { 1u * MS, 6u * MIB, 256u * KIB };
+//A different card, that splits anything above 64 KiB
+static const device other_sd = { 1u * MS, 6u * MIB, 64u * KIB };
+//A card that's slow to start every request
+static const device latent_sd = { 8u * MS, 12u * MIB, 0 };
+
+static const size_t candidates[A9L_TUNE_NUM_SIZES] = {
+	32u * KIB, 64u * KIB, 128u * KIB, 256u * KIB, 512u * KIB, A9L_TUNE_WINDOW
+};
+
+//Mixed sizes: 4 whole windows, none, and 1 and a half
+static const size_t payload_sizes[] = { 4u * MIB, 300u * KIB, 3u * MIB / 2u };
+static const size_t num_payloads = sizeof(payload_sizes)/sizeof(*payload_sizes);
+
+static char root[1024];
+static unsigned char *contents[3];
+static unsigned char *buffer;
+
+static void insert(const device *sd);
+static bool boot(a9l_tune *tune, size_t payloads, bool *written);
+static size_t expected_best(const device *sd);
+
+int main(void)
+{
+	if (!a9l_host_temp_directory(root, sizeof(root)))
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+
+	buffer = malloc(4u * MIB);
+	for (size_t i = 0; i < num_payloads; ++i)
+	{
+		contents[i] = malloc(payload_sizes[i]);
+		if (!contents[i] || !buffer)
+		{
+			printf("Unable to allocate payloads\n");
+			return 1;
+		}
+		for (size_t j = 0; j < payload_sizes[i]; ++j)
+			contents[i][j] = (unsigned char)(j * 31u + i);
+	}
+
+	insert(&fast_sd);
+	for (size_t i = 0; i < num_payloads; ++i)
+	{
+		char path[32];
+		snprintf(path, sizeof(path), "SD:/p%zu.bin", i);
+		a9l_host_put(path, contents[i], payload_sizes[i]);
+	}
+
+	a9l_tune tune;
+	bool written;
+
+	printf("Untuned drive, payloads smaller than a window\n");
+	insert(&latent_sd);
+	FILE *file = a9l_trace_fopen("SD:/p1.bin", "rb");
+	uint64_t start = a9l_host_clock();
+	CHECK(file && 1 == a9l_trace_fread(buffer, payload_sizes[1], 1, file));
+	uint64_t plain = a9l_host_clock() - start;
+	if (file)
+		a9l_trace_fclose(file);
+	for (size_t i = 0; i < 3; ++i)
+	{
+		start = a9l_host_clock();
+		CHECK(boot(&tune, 0, &written));
+		CHECK(a9l_host_clock() - start == plain);
+		CHECK(!written);
+		CHECK(!tune.drives[0].settled);
+	}
+	insert(&fast_sd);
+	size_t samples_per_boot = 5;
+	size_t boots = (A9L_TUNE_NUM_SIZES * A9L_TUNE_SAMPLES + samples_per_boot - 1) / samples_per_boot;
+
+	printf("Tuning over %zu boots of mixed payload sizes\n", boots);
+	for (size_t i = 0; i < boots; ++i)
+	{
+		CHECK(i == 0 || !tune.drives[0].settled);
+		CHECK(boot(&tune, num_payloads, &written));
+		CHECK(written);
+	}
+	CHECK(tune.drives[0].settled);
+	CHECK(expected_best(&fast_sd) == 3);
+	CHECK(tune.drives[0].best == expected_best(&fast_sd));
+	printf("  settled on %zu KiB chunks, %lu KiB/s\n", candidates[tune.drives[0].best] / KIB,
+		(unsigned long)(tune.drives[0].throughput[tune.drives[0].best] / KIB));
+	for (size_t i = 0; i < A9L_TUNE_NUM_SIZES; ++i)
+		CHECK(tune.drives[0].samples[i] >= A9L_TUNE_SAMPLES);
+
+	printf("Settled boots\n");
+	for (size_t i = 0; i < 4; ++i)
+	{
+		CHECK(boot(&tune, num_payloads, &written));
+		CHECK(!written);
+		CHECK(tune.drives[0].drift == 0);
+	}
+
+	printf("Payloads smaller than a window\n");
+	insert(&slow_sd);
+	CHECK(boot(&tune, 0, &written));
+	CHECK(!written);
+	CHECK(tune.drives[0].drift == 0);
+
+	printf("One slow boot\n");
+	insert(&slow_sd);
+	CHECK(boot(&tune, num_payloads, &written));
+	CHECK(written);
+	CHECK(tune.drives[0].settled && tune.drives[0].drift == 1);
+	insert(&fast_sd);
+	CHECK(boot(&tune, num_payloads, &written));
+	CHECK(written);
+	CHECK(tune.drives[0].settled && tune.drives[0].drift == 0);
+	CHECK(boot(&tune, num_payloads, &written));
+	CHECK(!written);
+
+	printf("Card replaced\n");
+	insert(&other_sd);
+	CHECK(boot(&tune, num_payloads, &written));
+	CHECK(tune.drives[0].settled && tune.drives[0].drift == 1);
+	CHECK(boot(&tune, num_payloads, &written));
+	CHECK(written);
+	CHECK(!tune.drives[0].settled);
+	for (size_t i = 0; i < boots; ++i)
+		CHECK(boot(&tune, num_payloads, &written));
+	CHECK(tune.drives[0].settled);
+	CHECK(expected_best(&other_sd) == 1);
+	CHECK(tune.drives[0].best == expected_best(&other_sd));
+	printf("  settled on %zu KiB chunks, %lu KiB/s\n", candidates[tune.drives[0].best] / KIB,
+		(unsigned long)(tune.drives[0].throughput[tune.drives[0].best] / KIB));
+	CHECK(boot(&tune, num_payloads, &written));
+	CHECK(!written);
+
+	for (size_t i = 0; i < num_payloads; ++i)
+		free(contents[i]);
+	free(buffer);
+	a9l_host_remove_directory(root);
+	return a9l_host_finish();
+}
+
+//Helper functions follow
+
+static void insert(const device *sd)
+{
+	a9l_host_reset();
+	a9l_host_map_drive("SD:", root);
+	a9l_host_set_device("SD:", sd->latency, sd->bandwidth, sd->knee);
+}
+
+//The bootloader's part of a boot with read tuning, loading the first payloads
+//of the list. Checks everything read matches the files.
+static bool boot(a9l_tune *tune, size_t payloads, bool *written)
+{
+	a9l_tune_read(tune, A9L_TUNE_FILE);
+
+	bool res = true;
+	for (size_t i = 0; i < payloads && res; ++i)
+	{
+		char path[32];
+		snprintf(path, sizeof(path), "SD:/p%zu.bin", i);
+		FILE *file = a9l_trace_fopen(path, "rb");
+		res = file && a9l_tune_fread(tune, path, buffer, payload_sizes[i], file) &&
+			memcmp(buffer, contents[i], payload_sizes[i]) == 0;
+		if (file)
+			a9l_trace_fclose(file);
+	}
+
+	//The payload smaller than a window is always read
+	FILE *file = a9l_trace_fopen("SD:/p1.bin", "rb");
+	res = res && file && a9l_tune_fread(tune, "SD:/p1.bin", buffer, payload_sizes[1], file) &&
+		memcmp(buffer, contents[1], payload_sizes[1]) == 0;
+	if (file)
+		a9l_trace_fclose(file);
+
+	a9l_tune_finish(tune);
+	a9l_host_reset_counters();
+	res = a9l_tune_write(tune, A9L_TUNE_FILE) && res;
+	*written = a9l_host_get_counters()->writes > 0;
+	return res;
+}
+
+//The candidate that reads a window fastest according to the device model
+static size_t expected_best(const device *sd)
+{
+	size_t best = 0;
+	uint64_t best_ticks = UINT64_MAX;
+	for (size_t i = 0; i < A9L_TUNE_NUM_SIZES; ++i)
+	{
+		uint64_t requests = (A9L_TUNE_WINDOW + candidates[i] - 1) / candidates[i];
+		uint64_t transfer = (uint64_t)candidates[i] * A9L_TIMER_FREQUENCY / sd->bandwidth;
+		if (candidates[i] > sd->knee)
+			transfer *= 2u;
+		uint64_t ticks = requests * (sd->latency + transfer);
+		if (ticks < best_ticks)
+		{
+			best = i;
+			best_ticks = ticks;
+		}
+	}
+	return best;
+}
+
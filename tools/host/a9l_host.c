@@ -0,0 +1,639 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "a9l_host.h"
+#include "a9l_trace.h"
+#include "a9l_timer.h"
+
+#include <ctr9/ctr_cache.h>
+#include <ctr9/io/ctr_drives.h>
+#include <ctrelf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ARRAY_SIZE(X) (sizeof(X)/sizeof(*X))
+
+#define NO_DRIVE A9L_HOST_MAX_DRIVES
+
+typedef struct
+{
+	char name[16];
+	char directory[1024];
+	uint32_t latency;
+	uint32_t bandwidth;
+	size_t knee;
+	bool async;
+	//When the device is done with the requests made so far
+	uint64_t busy_until;
+} host_drive;
+
+typedef struct
+{
+	FILE *file;
+	size_t drive;
+	//What the simulated stdio buffer holds
+	uint64_t buffer_start;
+	uint64_t buffer_end;
+	//The background read in progress, if any
+	bool pending;
+	uint64_t pending_start;
+	uint64_t pending_end;
+} open_file;
+
+static host_drive drives[A9L_HOST_MAX_DRIVES];
+static size_t current_drive = NO_DRIVE;
+static open_file open_files[16];
+static a9l_host_counters counters;
+static uint64_t clock_ticks;
+static int failures;
+
+static size_t find_drive(const char *path, size_t *length);
+static open_file *find_file(FILE *file);
+static size_t file_drive(FILE *file);
+static uint64_t cost(size_t drive, size_t bytes);
+static void charge(size_t drive, size_t bytes);
+static void charge_read(FILE *file, size_t bytes);
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw);
+static uint32_t read_u32(const unsigned char *data);
+static uint16_t read_u16(const unsigned char *data);
+
+void a9l_host_reset(void)
+{
+	memset(drives, 0, sizeof(drives));
+	memset(open_files, 0, sizeof(open_files));
+	current_drive = NO_DRIVE;
+	clock_ticks = 0;
+	a9l_host_reset_counters();
+}
+
+bool a9l_host_map_drive(const char *drive, const char *directory)
+{
+	size_t length;
+	size_t index = find_drive(drive, &length);
+	if (!length || length >= sizeof(drives[0].name))
+		return false;
+
+	if (!directory)
+	{
+		if (index != NO_DRIVE)
+			drives[index].directory[0] = '\0';
+		return true;
+	}
+
+	if (index == NO_DRIVE)
+	{
+		for (index = 0; index < A9L_HOST_MAX_DRIVES && drives[index].name[0]; ++index);
+		if (index == A9L_HOST_MAX_DRIVES)
+			return false;
+		memcpy(drives[index].name, drive, length);
+		drives[index].name[length] = '\0';
+	}
+
+	if (strlen(directory) >= sizeof(drives[index].directory))
+		return false;
+	strcpy(drives[index].directory, directory);
+	return true;
+}
+
+void a9l_host_set_device(const char *drive, uint32_t latency, uint32_t bandwidth, size_t knee)
+{
+	size_t length;
+	size_t index = find_drive(drive, &length);
+	if (index == NO_DRIVE)
+		return;
+
+	drives[index].latency = latency;
+	drives[index].bandwidth = bandwidth;
+	drives[index].knee = knee;
+}
+
+void a9l_host_set_async(const char *drive, bool async)
+{
+	size_t length;
+	size_t index = find_drive(drive, &length);
+	if (index != NO_DRIVE)
+		drives[index].async = async;
+}
+
+void a9l_host_advance(uint64_t ticks)
+{
+	clock_ticks += ticks;
+}
+
+uint64_t a9l_host_clock(void)
+{
+	return clock_ticks;
+}
+
+const a9l_host_counters *a9l_host_get_counters(void)
+{
+	return &counters;
+}
+
+void a9l_host_reset_counters(void)
+{
+	memset(&counters, 0, sizeof(counters));
+}
+
+bool a9l_host_resolve(const char *path, char *resolved, size_t size)
+{
+	size_t length;
+	size_t index = find_drive(path, &length);
+	if (!length)
+		index = current_drive;
+	if (index == NO_DRIVE || !drives[index].directory[0])
+		return false;
+
+	const char *rest = path + length;
+	while (*rest == '/')
+		rest++;
+	int res = snprintf(resolved, size, "%s/%s", drives[index].directory, rest);
+	return res > 0 && (size_t)res < size;
+}
+
+bool a9l_host_temp_directory(char *path, size_t size)
+{
+	const char *base = getenv("TMPDIR");
+	int res = snprintf(path, size, "%s/a9l_host_XXXXXX", base && base[0] ? base : "/tmp");
+	return res > 0 && (size_t)res < size && mkdtemp(path);
+}
+
+bool a9l_host_remove_directory(const char *path)
+{
+	return nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+bool a9l_host_write_file(const char *path, const void *data, size_t size)
+{
+	char resolved[2048];
+	if (!a9l_host_resolve(path, resolved, sizeof(resolved)))
+		return false;
+
+	for (char *slash = strchr(resolved + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+	{
+		*slash = '\0';
+		mkdir(resolved, 0755);
+		*slash = '/';
+	}
+
+	FILE *file = fopen(resolved, "wb");
+	if (!file)
+		return false;
+	bool res = !size || 1 == fwrite(data, size, 1, file);
+	return fclose(file) == 0 && res;
+}
+
+bool a9l_host_map_memory(uintptr_t address, size_t size)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_FIXED_NOREPLACE
+	flags |= MAP_FIXED_NOREPLACE;
+#endif
+	void *memory = mmap((void*)address, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (memory == MAP_FAILED)
+		return false;
+	//Without MAP_FIXED_NOREPLACE the address is only a hint
+	if (memory != (void*)address)
+	{
+		munmap(memory, size);
+		return false;
+	}
+	return true;
+}
+
+void a9l_host_check(bool ok, const char *what, int line)
+{
+	if (!ok)
+	{
+		printf("  line %d: %s failed\n", line, what);
+		failures++;
+	}
+}
+
+void a9l_host_fail(void)
+{
+	failures++;
+}
+
+int a9l_host_failures(void)
+{
+	return failures;
+}
+
+int a9l_host_finish(void)
+{
+	printf("%s\n", failures ? "FAILED" : "All tests passed");
+	return failures ? 1 : 0;
+}
+
+bool a9l_host_put(const char *path, const void *data, size_t size)
+{
+	if (!a9l_host_write_file(path, data, size))
+	{
+		printf("  unable to write %s\n", path);
+		failures++;
+		return false;
+	}
+	return true;
+}
+
+bool a9l_host_put_text(const char *path, const char *text)
+{
+	return a9l_host_put(path, text, strlen(text));
+}
+
+bool a9l_host_put_time(const char *path, const void *data, size_t size, time_t time)
+{
+	char resolved[2048];
+	struct timespec times[2] = { { time, 0 }, { time, 0 } };
+	if (!a9l_host_put(path, data, size))
+		return false;
+	if (!a9l_host_resolve(path, resolved, sizeof(resolved)) || utimensat(AT_FDCWD, resolved, times, 0))
+	{
+		printf("  unable to set the time of %s\n", path);
+		failures++;
+		return false;
+	}
+	return true;
+}
+
+bool a9l_host_delete(const char *path)
+{
+	char resolved[2048];
+	if (!a9l_host_resolve(path, resolved, sizeof(resolved)) || remove(resolved))
+	{
+		printf("  unable to remove %s\n", path);
+		failures++;
+		return false;
+	}
+	return true;
+}
+
+//ARM9 stand-ins
+
+void a9l_timer_initialize(void)
+{
+}
+
+uint32_t a9l_timer_get_ticks(void)
+{
+	return (uint32_t)clock_ticks;
+}
+
+void ctr_cache_clean_data_range(void *start, void *end)
+{
+	(void)start;
+	(void)end;
+}
+
+void ctr_cache_flush_instruction_range(void *start, void *end)
+{
+	(void)start;
+	(void)end;
+}
+
+void ctr_cache_drain_write_buffer(void)
+{
+}
+
+int ctr_drives_chdrive(const char *drive)
+{
+	if (ctr_drives_check_ready(drive))
+		return -1;
+
+	size_t length;
+	current_drive = find_drive(drive, &length);
+	return 0;
+}
+
+int ctr_drives_check_ready(const char *drive)
+{
+	size_t length;
+	size_t index = find_drive(drive, &length);
+	return index != NO_DRIVE && drives[index].directory[0] ? 0 : -1;
+}
+
+void elf_load_header(Elf32_Ehdr *header, const void *data)
+{
+	const unsigned char *bytes = data;
+	memcpy(header->e_ident, bytes, EI_NIDENT);
+	header->e_type = read_u16(bytes + 16);
+	header->e_machine = read_u16(bytes + 18);
+	header->e_version = read_u32(bytes + 20);
+	header->e_entry = read_u32(bytes + 24);
+	header->e_phoff = read_u32(bytes + 28);
+	header->e_shoff = read_u32(bytes + 32);
+	header->e_flags = read_u32(bytes + 36);
+	header->e_ehsize = read_u16(bytes + 40);
+	header->e_phentsize = read_u16(bytes + 42);
+	header->e_phnum = read_u16(bytes + 44);
+	header->e_shentsize = read_u16(bytes + 46);
+	header->e_shnum = read_u16(bytes + 48);
+	header->e_shstrndx = read_u16(bytes + 50);
+}
+
+void elf_load_program_header(Elf32_Phdr *header, const void *data)
+{
+	const unsigned char *bytes = data;
+	header->p_type = read_u32(bytes);
+	header->p_offset = read_u32(bytes + 4);
+	header->p_vaddr = read_u32(bytes + 8);
+	header->p_paddr = read_u32(bytes + 12);
+	header->p_filesz = read_u32(bytes + 16);
+	header->p_memsz = read_u32(bytes + 20);
+	header->p_flags = read_u32(bytes + 24);
+	header->p_align = read_u32(bytes + 28);
+}
+
+//Boot I/O, in place of src/a9l_trace.c
+
+void a9l_trace_initialize(void)
+{
+}
+
+void a9l_trace_resume(void)
+{
+}
+
+int a9l_trace_write(void)
+{
+	return 0;
+}
+
+FILE *a9l_trace_fopen(const char *path, const char *mode)
+{
+	char resolved[2048];
+	size_t length;
+	size_t drive = find_drive(path, &length);
+	if (!length)
+		drive = current_drive;
+
+	FILE *file = NULL;
+	if (a9l_host_resolve(path, resolved, sizeof(resolved)))
+		file = fopen(resolved, mode);
+
+	counters.opens++;
+	if (!file)
+	{
+		counters.failed_opens++;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(open_files); ++i)
+	{
+		if (!open_files[i].file)
+		{
+			open_files[i].file = file;
+			open_files[i].drive = drive;
+			open_files[i].buffer_start = 0;
+			open_files[i].buffer_end = 0;
+			open_files[i].pending = false;
+			break;
+		}
+	}
+	return file;
+}
+
+int a9l_trace_fclose(FILE *file)
+{
+	a9l_trace_fcancel(file);
+	for (size_t i = 0; i < ARRAY_SIZE(open_files); ++i)
+	{
+		if (open_files[i].file == file)
+		{
+			open_files[i].file = NULL;
+			break;
+		}
+	}
+	return fclose(file);
+}
+
+size_t a9l_trace_fread(void *buffer, size_t size, size_t count, FILE *file)
+{
+	counters.reads++;
+	counters.bytes_read += size * count;
+	charge_read(file, size * count);
+	return fread(buffer, size, count, file);
+}
+
+size_t a9l_trace_fwrite(const void *buffer, size_t size, size_t count, FILE *file)
+{
+	counters.writes++;
+	counters.bytes_written += size * count;
+	charge(file_drive(file), size * count);
+	return fwrite(buffer, size, count, file);
+}
+
+int a9l_trace_fseek(FILE *file, long offset, int whence)
+{
+	counters.seeks++;
+	return fseek(file, offset, whence);
+}
+
+int a9l_trace_stat(const char *path, struct stat *st)
+{
+	char resolved[2048];
+	counters.stats++;
+	if (!a9l_host_resolve(path, resolved, sizeof(resolved)))
+		return -1;
+	return stat(resolved, st);
+}
+
+int a9l_trace_fstat(FILE *file, struct stat *st)
+{
+	counters.stats++;
+	return fstat(fileno(file), st);
+}
+
+int a9l_trace_chdrive(const char *drive)
+{
+	return ctr_drives_chdrive(drive);
+}
+
+int a9l_trace_check_ready(const char *drive)
+{
+	return ctr_drives_check_ready(drive);
+}
+
+void a9l_trace_selection(bool hit)
+{
+	if (hit)
+		counters.selection_hits++;
+	else
+		counters.selection_misses++;
+}
+
+void a9l_trace_prefetch(bool hit)
+{
+	if (hit)
+		counters.prefetch_hits++;
+	else
+		counters.prefetch_misses++;
+}
+
+//The data is read right away, it just isn't paid for until it is waited for
+bool a9l_trace_fread_async(void *buffer, size_t size, FILE *file)
+{
+	open_file *open = find_file(file);
+	if (!open || open->drive == NO_DRIVE || !drives[open->drive].async || open->pending)
+		return false;
+
+	host_drive *device = &drives[open->drive];
+	counters.reads++;
+	counters.async_reads++;
+	counters.bytes_read += size;
+	open->buffer_start = open->buffer_end = 0;
+	open->pending = true;
+	open->pending_start = device->busy_until > clock_ticks ? device->busy_until : clock_ticks;
+	open->pending_end = open->pending_start + cost(open->drive, size);
+	device->busy_until = open->pending_end;
+	return size == fread(buffer, 1, size, file);
+}
+
+bool a9l_trace_fwait(FILE *file)
+{
+	open_file *open = find_file(file);
+	if (open && open->pending)
+	{
+		if (open->pending_end > clock_ticks)
+			clock_ticks = open->pending_end;
+		open->pending = false;
+	}
+	return true;
+}
+
+void a9l_trace_fcancel(FILE *file)
+{
+	open_file *open = find_file(file);
+	if (!open || !open->pending)
+		return;
+
+	//A read that hasn't started yet is simply dropped, one that has is stopped
+	//with another request
+	host_drive *device = &drives[open->drive];
+	if (open->pending_end > clock_ticks)
+	{
+		if (open->pending_start >= clock_ticks)
+			device->busy_until = open->pending_start;
+		else if (clock_ticks + device->latency < open->pending_end)
+			device->busy_until = clock_ticks + device->latency;
+	}
+	open->pending = false;
+}
+
+//Helper functions follow
+
+static size_t find_drive(const char *path, size_t *length)
+{
+	const char *colon = strchr(path, ':');
+	*length = colon ? (size_t)(colon - path) + 1 : 0;
+	if (!colon)
+		return NO_DRIVE;
+
+	for (size_t i = 0; i < A9L_HOST_MAX_DRIVES; ++i)
+	{
+		if (drives[i].name[0] && strlen(drives[i].name) == *length &&
+			strncmp(drives[i].name, path, *length) == 0)
+			return i;
+	}
+	return NO_DRIVE;
+}
+
+static open_file *find_file(FILE *file)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(open_files); ++i)
+	{
+		if (open_files[i].file == file)
+			return &open_files[i];
+	}
+	return NULL;
+}
+
+static size_t file_drive(FILE *file)
+{
+	open_file *open = find_file(file);
+	return open ? open->drive : NO_DRIVE;
+}
+
+static uint64_t cost(size_t drive, size_t bytes)
+{
+	const host_drive *device = &drives[drive];
+	uint64_t ticks = device->latency;
+	if (device->bandwidth)
+	{
+		uint64_t transfer = (uint64_t)bytes * A9L_TIMER_FREQUENCY / device->bandwidth;
+		if (device->knee && bytes > device->knee)
+			transfer *= 2u;
+		ticks += transfer;
+	}
+	return ticks;
+}
+
+//Waits for the device to be done with any background read first
+static void charge(size_t drive, size_t bytes)
+{
+	if (drive == NO_DRIVE)
+		return;
+
+	host_drive *device = &drives[drive];
+	if (device->busy_until > clock_ticks)
+		clock_ticks = device->busy_until;
+	clock_ticks += cost(drive, bytes);
+	device->busy_until = clock_ticks;
+}
+
+static void charge_read(FILE *file, size_t bytes)
+{
+	open_file *open = find_file(file);
+	long position = ftell(file);
+	if (!open || position < 0)
+		return;
+
+	if (bytes >= A9L_HOST_BUFFER_SIZE)
+	{
+		open->buffer_start = open->buffer_end = 0;
+		charge(open->drive, bytes);
+		return;
+	}
+
+	uint64_t start = (uint64_t)position;
+	if (start >= open->buffer_start && start + bytes <= open->buffer_end)
+		return;
+
+	open->buffer_start = start;
+	open->buffer_end = start + A9L_HOST_BUFFER_SIZE;
+	charge(open->drive, A9L_HOST_BUFFER_SIZE);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	(void)st;
+	(void)flag;
+	(void)ftw;
+	return remove(path);
+}
+
+static uint32_t read_u32(const unsigned char *data)
+{
+	return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t read_u16(const unsigned char *data)
+{
+	return (uint16_t)(data[0] | data[1] << 8);
+}
+
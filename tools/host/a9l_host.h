@@ -0,0 +1,119 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+#ifndef A9L_HOST_H_
+#define A9L_HOST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+//Host stand-ins for libctr9 and the ARM9 timers, so the boot modules in src/
+//can be built and exercised on a PC. They are built with -DA9L_TRACE, and this
+//layer provides the a9l_trace_* functions instead of src/a9l_trace.c, so every
+//file and drive access the modules make lands here:
+//
+//  -Drives are directories. "SD:/a/b" opens DIR/a/b once SD: is mapped to DIR.
+//   Paths without a drive are relative to the drive last changed to. Unmapped
+//   drives are not ready, and nothing on them can be opened.
+//  -Each drive is a simulated device. Reads and writes advance a simulated
+//   clock, which is what a9l_timer_get_ticks returns, by the device's latency
+//   plus the transfer time at its bandwidth. Like stdio, reads smaller than
+//   A9L_HOST_BUFFER_SIZE are served from a buffer that is refilled a whole
+//   buffer at a time.
+//  -Devices can be made asynchronous, so a9l_trace_fread_async reads go on in
+//   the background: the clock only moves when they are waited for, and other
+//   requests to the same device wait for them to finish first. Stopping one
+//   with a9l_trace_fcancel frees the device after a request's latency.
+//  -Every access is counted.
+
+#define A9L_HOST_MAX_DRIVES 4u
+
+//newlib's BUFSIZ
+#define A9L_HOST_BUFFER_SIZE 1024u
+
+typedef struct
+{
+	uint64_t opens;
+	uint64_t failed_opens;
+	uint64_t reads;
+	uint64_t bytes_read;
+	uint64_t writes;
+	uint64_t bytes_written;
+	uint64_t seeks;
+	uint64_t stats;
+	uint64_t selection_hits;
+	uint64_t selection_misses;
+	uint64_t async_reads;
+	uint64_t prefetch_hits;
+	uint64_t prefetch_misses;
+} a9l_host_counters;
+
+//Unmaps every drive, resets the devices, counters and clock
+void a9l_host_reset(void);
+
+//Maps drive (e.g. "SD:") to directory. A NULL directory unmaps the drive, as
+//if its medium was removed.
+bool a9l_host_map_drive(const char *drive, const char *directory);
+
+//latency is in timer ticks per request, bandwidth in bytes per second. A
+//request larger than knee bytes transfers at half the bandwidth, like a
+//controller that has to split it up; 0 disables this. By default devices are
+//free, and the clock only moves with a9l_host_advance.
+void a9l_host_set_device(const char *drive, uint32_t latency, uint32_t bandwidth, size_t knee);
+
+//Whether the drive can read in the background, off by default like on the
+//console
+void a9l_host_set_async(const char *drive, bool async);
+
+//Moves the simulated clock forward, e.g. to account for work done in between
+//accesses
+void a9l_host_advance(uint64_t ticks);
+uint64_t a9l_host_clock(void);
+
+const a9l_host_counters *a9l_host_get_counters(void);
+void a9l_host_reset_counters(void);
+
+//Writes the host path of a drive path into resolved. Returns false if its drive
+//isn't mapped or it doesn't fit.
+bool a9l_host_resolve(const char *path, char *resolved, size_t size);
+
+//Helpers for tests. a9l_host_temp_directory makes a new directory for drive
+//images, and a9l_host_remove_directory removes one and everything in it.
+//a9l_host_write_file writes a file to a mapped drive, e.g. "SD:/a/b.bin",
+//creating its directories.
+bool a9l_host_temp_directory(char *path, size_t size);
+bool a9l_host_remove_directory(const char *path);
+bool a9l_host_write_file(const char *path, const void *data, size_t size);
+
+//Makes [address, address + size) usable on the host, so payloads can be loaded
+//to the ARM9 addresses they were built for. Returns false if the host already
+//has something there.
+bool a9l_host_map_memory(uintptr_t address, size_t size);
+
+//Scaffolding for the host tests. CHECK(X) counts a failure, printing the line
+//and text of X, if X doesn't hold, and a9l_host_fail counts one found some
+//other way. a9l_host_finish prints the outcome and returns main's exit status.
+#define CHECK(X) a9l_host_check((X), #X, __LINE__)
+void a9l_host_check(bool ok, const char *what, int line);
+void a9l_host_fail(void);
+int a9l_host_failures(void);
+int a9l_host_finish(void);
+
+//Like a9l_host_write_file, but counts a failure if the file can't be written.
+//a9l_host_put_text writes a string without its terminator, and
+//a9l_host_put_time also sets the file's modification time. a9l_host_delete
+//removes a file from a mapped drive, and counts a failure if it can't.
+bool a9l_host_put(const char *path, const void *data, size_t size);
+bool a9l_host_put_text(const char *path, const char *text);
+bool a9l_host_put_time(const char *path, const void *data, size_t size, time_t time);
+bool a9l_host_delete(const char *path);
+
+#endif//A9L_HOST_H_
+
@@ -0,0 +1,20 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host stand-in for libctr9's header, see tools/host/a9l_host.h. There are no
+//caches to maintain on the host, so these do nothing.
+
+#ifndef CTR9_CTR_CACHE_H_
+#define CTR9_CTR_CACHE_H_
+
+void ctr_cache_clean_data_range(void *start, void *end);
+void ctr_cache_flush_instruction_range(void *start, void *end);
+void ctr_cache_drain_write_buffer(void);
+
+#endif//CTR9_CTR_CACHE_H_
+
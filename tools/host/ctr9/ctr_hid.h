@@ -0,0 +1,33 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host stand-in for libctr9's header, see tools/host/a9l_host.h. The values
+//match the ARM9 HID register bits.
+
+#ifndef CTR9_CTR_HID_H_
+#define CTR9_CTR_HID_H_
+
+typedef enum
+{
+	CTR_HID_NONE = 0,
+	CTR_HID_A = 1 << 0,
+	CTR_HID_B = 1 << 1,
+	CTR_HID_SELECT = 1 << 2,
+	CTR_HID_START = 1 << 3,
+	CTR_HID_RIGHT = 1 << 4,
+	CTR_HID_LEFT = 1 << 5,
+	CTR_HID_UP = 1 << 6,
+	CTR_HID_DOWN = 1 << 7,
+	CTR_HID_R = 1 << 8,
+	CTR_HID_L = 1 << 9,
+	CTR_HID_X = 1 << 10,
+	CTR_HID_Y = 1 << 11
+} ctr_hid_button_type;
+
+#endif//CTR9_CTR_HID_H_
+
@@ -0,0 +1,19 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host stand-in for libctr9's header, see tools/host/a9l_host.h
+
+#ifndef CTR9_IO_H_
+#define CTR9_IO_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#endif//CTR9_IO_H_
+
@@ -0,0 +1,19 @@
+/*******************************************************************************
+ * Copyright (C) 2016 Gabriel Marcano
+ *
+ * Refer to the COPYING.txt file at the top of the project directory. If that is
+ * missing, this file is licensed under the GPL version 2.0 or later.
+ *
+ ******************************************************************************/
+
+//Host stand-in for libctr9's header, see tools/host/a9l_host.h. Drives are
+//directories mapped with a9l_host_map_drive.
+
+#ifndef CTR9_IO_CTR_DRIVES_H_
+#define CTR9_IO_CTR_DRIVES_H_
+
+int ctr_drives_chdrive(const char *drive);
+int ctr_drives_check_ready(const char *drive);
+
+#endif//CTR9_IO_CTR_DRIVES_H_
+